@@ -0,0 +1,43 @@
+#pragma once
+
+#include "boot_timeline.h"
+#include "bus_monitor.h"
+#include "can_events.h"
+#include "can_manager.h"
+#include "can_trace.h"
+#include "esp32_can.h"
+#include "hal.h"
+#include "main_vars.h"
+#include "metrics.h"
+#include "mqtt_manager.h"
+#include "ota.h"
+#include "settings_store.h"
+#include "telemetry.h"
+#include "unknown_frames.h"
+
+// one simulated BYD battery: every module of the firmware core as an instance wired to its own backends, the esp32
+// build runs exactly one of them, the native simulator as many as it likes side by side
+class Battery {
+ public:
+  explicit Battery(Hal& hal, const char* module_topic = mqtt_topic);
+  Battery(const Battery&) = delete;
+  Battery& operator=(const Battery&) = delete;
+
+  void begin();    // can first, the inverter sees limit frames before any network is up
+  void connect();  // starts the mqtt session, call once the network is there
+  void loop();
+
+  Hal& hal;
+  BootTimeline boot;
+  MqttManager mqtt;
+  Telemetry telemetry;
+  CanTrace trace;
+  UnknownFrames unknown;
+  CanEvents events;
+  BusMonitor monitor;
+  ESP32Can bus;
+  CanManager can;
+  SettingsStore store;
+  Ota ota;
+  Metrics metrics;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+// micros() at which each startup stage was first reached, the stages are marked from whichever task gets there
+// (can task, wifi loop, mqtt callback) and published once the mqtt session is up
+class BootTimeline {
+ public:
+  enum Stage : uint8_t { can_started, first_can_tx, wifi_connected, time_synced, mqtt_connected, stage_count };
+
+  void mark(const Stage stage, const unsigned long now_us) {
+    unsigned long expected = 0;
+    at_us[stage].compare_exchange_strong(expected, now_us == 0 ? 1 : now_us);  // 0 means not reached
+  }
+  bool reached(const Stage stage) const { return at_us[stage].load(std::memory_order_relaxed) != 0; }
+  unsigned long at(const Stage stage) const { return at_us[stage].load(std::memory_order_relaxed); }
+  static const char* name(const Stage stage) {
+    static constexpr const char* names[] = {"can_started", "first_can_tx", "wifi_connected", "time_synced",
+                                            "mqtt_connected"};
+    return stage < stage_count ? names[stage] : "unknown";
+  }
+
+ private:
+  std::atomic<unsigned long> at_us[stage_count]{};
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "hal.h"
+#include "main_vars.h"
+
+class Battery;
+
+// bus analytics: frames per direction and id, the load estimated from the exact on-wire length of every frame, and
+// the error counters, aggregated per interval on the can side and handed over as one summary. the mqtt side turns
+// that into the bus json and raises / clears alarms, so an error storm costs one message per interval, not per alert.
+// with can_hw_filter the rx side only sees accepted ids, the load is a lower bound then
+class BusMonitor {
+ public:
+  enum Direction : uint8_t { rx, tx };
+  enum Alarm : uint8_t { alarm_errors = 1U << 0, alarm_load = 1U << 1, alarm_rx_drop = 1U << 2 };
+
+  explicit BusMonitor(Battery& battery);
+
+  void frame(Direction direction, const CanFrame& frame);  // can side
+  void alerts(uint32_t alerts, const CanStatus& status);  // can side, every service pass, also closes the interval
+  void loop();                                            // mqtt side, publishes a closed interval
+  // bits on the wire including stuff bits, crc, ack, end of frame and intermission
+  static uint16_t frameBits(const CanFrame& frame);
+
+  // last closed interval as seen by the mqtt side
+  uint16_t load_hundredths = 0;  // percent with two decimals
+  uint8_t alarms = 0;
+  uint32_t alarms_raised = 0;  // alarm bits that went from clear to set
+  uint32_t intervals = 0;
+  uint32_t intervals_lost = 0;  // can side, closed while the mqtt side still had the previous one
+
+ private:
+  struct IdCount {
+    uint32_t key;
+    uint32_t frames[2];
+  };
+
+  struct Interval {
+    unsigned long length_ms;
+    uint32_t frames[2];
+    uint32_t bits;
+    uint32_t tx_failed;      // attempts, from the tx queue
+    uint32_t error_passive;  // alerts
+    uint32_t bus_errors;  // deltas of the driver counters
+    uint32_t rx_missed;
+    uint32_t rx_overrun;
+    uint32_t other_frames;  // ids that found no free counter
+    uint8_t id_count;
+    IdCount ids[bus_monitor_ids];
+  };
+
+  Battery& battery;
+  Hal& hal;
+  Interval current{};  // can side
+  Interval closed{};   // owned by the mqtt side while ready is set
+  std::atomic<bool> ready{false};
+  unsigned long interval_start_ms = 0;
+  CanStatus last_status{};
+  uint32_t last_tx_failed = 0;
+  int32_t last_rx_rate = 0;  // mqtt side, rx frames per 10 s of the interval before
+  void close(const CanStatus& status, unsigned long now_ms);
+  void publish(const Interval& interval);
+};
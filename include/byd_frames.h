@@ -0,0 +1,43 @@
+#pragma once
+
+#include "can_codec.h"
+#include "can_manager.h"
+
+// BYD frame layouts, one line per signal: raw type, byte offset, variable, scale
+
+// sent to the inverter
+
+using LimitsFrame = FrameCodec<0x110,
+                               Signal<uint16_t, 0, &CanManager::limit_battery_voltage_max, 10>,       // 230V max
+                               Signal<uint16_t, 2, &CanManager::limit_battery_voltage_min, 10>,       // 170V min
+                               Signal<uint16_t, 4, &CanManager::effective_discharge_current_max, 10>,  // 25,6A
+                               Signal<uint16_t, 6, &CanManager::effective_charge_current_max, 10>>;    // 25,6A
+
+using BatteryInfoFrame = FrameCodec<0x1d0,
+                                    Signal<int16_t, 0, &CanManager::battery_voltage, 10>,  // 215V battery voltage
+                                    Signal<int16_t, 2, &CanManager::battery_current, 10>,  // 4,3A battery current
+                                    Signal<int16_t, 4, &CanManager::battery_temp, 10>,     // 22°C battery temp
+                                    ConstSignal<int16_t, 6, 776>>;  // some sort of status bytes?
+
+using CellInfoFrame = FrameCodec<0x210,
+                                 Signal<uint16_t, 0, &CanManager::cell_temp_max, 10>,  // 23°C max cell temp
+                                 Signal<uint16_t, 2, &CanManager::cell_temp_min, 10>>;  // 22°C min cell temp
+
+using StatesFrame =
+    FrameCodec<0x150,
+               Signal<uint16_t, 0, &CanManager::soc_percent, 100>,           // 28,7% soc % Vrfd
+               Signal<uint16_t, 2, &CanManager::soh_percent, 100>,           // 100% soh % Vrfd
+               Signal<uint16_t, 4, &CanManager::remaining_capacity_ah, 10>,  // 1/10Ah (ignored by sungrow?)
+               Signal<uint16_t, 6, &CanManager::full_capacity_ah, 10>>;      // 1/10Ah (ignored by sungrow?)
+
+// received from the inverter
+
+using InverterBatteryFrame =
+    FrameCodec<0x91,
+               Signal<uint16_t, 0, &CanManager::inverter_battery_voltage, 10>,
+               Signal<int16_t, 2, &CanManager::inverter_battery_current, 10>,  // signed, feeds the soc model
+               Signal<uint16_t, 4, &CanManager::inverter_temperature, 10>>;
+
+using InverterSocFrame = FrameCodec<0xd1, Signal<uint16_t, 0, &CanManager::inverter_soc, 10>>;
+
+using InverterTimestampFrame = FrameCodec<0x111, Signal<uint32_t, 0, &CanManager::inverter_timestamp>>;
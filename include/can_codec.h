@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+// compile-time description of big-endian (BYD) frame layouts, every signal expands to a fixed sequence of
+// shifts and stores at its offset, there is no runtime table to walk
+
+template <typename U, size_t... I>
+constexpr void storeBigEndian(uint8_t* data, const U raw, std::index_sequence<I...>) {
+  ((data[I] = static_cast<uint8_t>(raw >> (8 * (sizeof...(I) - 1 - I)))), ...);
+}
+
+template <typename U, size_t... I>
+constexpr U loadBigEndian(const uint8_t* data, std::index_sequence<I...>) {
+  return static_cast<U>(((static_cast<U>(data[I]) << (8 * (sizeof...(I) - 1 - I))) | ...));
+}
+
+template <typename Member>
+struct MemberTraits;
+
+template <typename Class, typename Member>
+struct MemberTraits<Member Class::*> {
+  using Object = Class;
+  using Value = Member;
+};
+
+// raw = value * Scale, stored as T (signedness follows T) at byte Offset, Var is the source/target data member
+template <typename T, size_t Offset, auto Var, uint32_t Scale = 1>
+struct Signal {
+  static_assert(std::is_integral_v<T>, "raw signal type must be integral");
+  static_assert(Offset + sizeof(T) <= 8, "signal exceeds the 8 data bytes");
+
+  using Raw = T;
+  using Object = typename MemberTraits<decltype(Var)>::Object;
+  using Value = typename MemberTraits<decltype(Var)>::Value;
+  static constexpr size_t offset = Offset;
+  static constexpr uint32_t scale = Scale;
+
+  static constexpr T toRaw(const Value value) {
+    if constexpr (std::is_floating_point_v<Value>) {
+      // rounded half away from zero and saturated, a plain cast turns 0.53% into 52 and wraps out of range values
+      const Value scaled = value * static_cast<Value>(Scale);
+      if (!(scaled > static_cast<Value>(std::numeric_limits<T>::min()))) return std::numeric_limits<T>::min();  // nan
+      if (scaled >= static_cast<Value>(std::numeric_limits<T>::max())) return std::numeric_limits<T>::max();
+      return static_cast<T>(scaled < 0 ? scaled - static_cast<Value>(0.5) : scaled + static_cast<Value>(0.5));
+    } else {
+      return static_cast<T>(value * Scale);
+    }
+  }
+
+  static constexpr Value fromRaw(const T raw) {
+    if constexpr (std::is_floating_point_v<Value>) {
+      return static_cast<Value>(raw) * (static_cast<Value>(1) / static_cast<Value>(Scale));
+    } else {
+      return static_cast<Value>(raw / Scale);
+    }
+  }
+
+  static constexpr void put(uint8_t* data, const T raw) {
+    using U = std::make_unsigned_t<T>;
+    storeBigEndian<U>(data + Offset, static_cast<U>(raw), std::make_index_sequence<sizeof(T)>{});
+  }
+
+  static constexpr T get(const uint8_t* data) {
+    using U = std::make_unsigned_t<T>;
+    return static_cast<T>(loadBigEndian<U>(data + Offset, std::make_index_sequence<sizeof(T)>{}));
+  }
+
+  static void encode(const Object& object, uint8_t* data) { put(data, toRaw(object.*Var)); }
+  static void decode(Object& object, const uint8_t* data) { object.*Var = fromRaw(get(data)); }
+};
+
+// fixed raw value that is always sent, ignored when decoding
+template <typename T, size_t Offset, T RawValue>
+struct ConstSignal {
+  static_assert(Offset + sizeof(T) <= 8, "signal exceeds the 8 data bytes");
+
+  template <typename Object>
+  static constexpr void encode(const Object&, uint8_t* data) {
+    using U = std::make_unsigned_t<T>;
+    storeBigEndian<U>(data + Offset, static_cast<U>(RawValue), std::make_index_sequence<sizeof(T)>{});
+  }
+  template <typename Object>
+  static constexpr void decode(Object&, const uint8_t*) {}
+};
+
+template <uint32_t Id, typename... Signals>
+struct FrameCodec {
+  static constexpr uint32_t id = Id;
+
+  template <typename Object>
+  static void encode(const Object& object, uint8_t* data) {
+    (Signals::encode(object, data), ...);
+  }
+  template <typename Object>
+  static void decode(Object& object, const uint8_t* data) {
+    (Signals::decode(object, data), ...);
+  }
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+
+constexpr uint32_t can_dispatch_extended = 0x80000000;  // key bit separating 29 bit ids from 11 bit ones
+
+inline uint32_t canDispatchKey(const CanFrame& frame) {
+  return frame.id | (frame.extd ? can_dispatch_extended : 0);
+}
+
+// multiplicative hash of a dispatch key onto a power of two slot count, 32 bit math like on the esp32
+constexpr size_t canDispatchSlot(const uint32_t key, const size_t slots) {
+  return static_cast<uint32_t>(key * 2654435761U) >> 8 & (slots - 1);
+}
+
+// same semantics as the TWAI acceptance filter (mask bit set = don't care), lets the fake driver emulate it
+inline bool canFilterAccepts(const CanFilter& filter, const CanFrame& frame) {
+  if (filter.single_filter) {
+    const uint32_t bits = frame.extd ? (frame.id << 3) | (frame.rtr ? 1UL << 2 : 0)
+                                     : (frame.id << 21) | (frame.rtr ? 1UL << 20 : 0) |
+                                           (frame.len > 0 ? static_cast<uint32_t>(frame.data[0]) << 8 : 0) |
+                                           (frame.len > 1 ? frame.data[1] : 0);
+    return ((bits ^ filter.acceptance_code) & ~filter.acceptance_mask) == 0;
+  }
+  // dual filter mode: std frames match id + rtr + first data byte nibble, ext frames only the 16 id msbs
+  const uint32_t first = frame.extd ? frame.id >> 13 : (frame.id << 5) | (frame.rtr ? 1UL << 4 : 0) |
+                                                           (frame.len > 0 ? frame.data[0] >> 4 : 0);
+  const uint32_t second = frame.extd ? frame.id >> 13 : (frame.id << 5) | (frame.rtr ? 1UL << 4 : 0) |
+                                                            (frame.len > 0 ? frame.data[0] & 0xF : 0);
+  const bool match_1 = ((first ^ (filter.acceptance_code >> 16)) & ~(filter.acceptance_mask >> 16) & 0xFFFF) == 0;
+  const bool match_2 = ((second ^ filter.acceptance_code) & ~filter.acceptance_mask & 0xFFFF) == 0;
+  return match_1 || match_2;
+}
+
+// flat open addressing table from can id to handler, lookup is a multiply and (almost always) one probe
+template <size_t Slots, typename Context>
+class CanDispatcher {
+  static_assert(Slots > 0 && (Slots & (Slots - 1)) == 0, "slot count must be a power of two");
+
+ public:
+  using Handler = void (*)(Context& context, const CanFrame& frame);
+
+  bool add(const uint32_t key, const Handler handler) {
+    if (count >= Slots / 2) {
+      return false;  // keep the probe chains short
+    }
+    for (size_t i = canDispatchSlot(key, Slots);; i = (i + 1) & (Slots - 1)) {
+      if (slots[i].handler == nullptr || slots[i].key == key) {
+        count += slots[i].handler == nullptr;
+        slots[i] = {key, handler};
+        return true;
+      }
+    }
+  }
+
+  Handler find(const uint32_t key) const {
+    for (size_t i = canDispatchSlot(key, Slots);; i = (i + 1) & (Slots - 1)) {
+      if (slots[i].handler == nullptr || slots[i].key == key) {
+        return slots[i].handler;
+      }
+    }
+  }
+
+  // narrowest TWAI acceptance filter for the registered standard ids: tries one filter over all ids and every
+  // split into the two dual mode filters, picking the one that lets the fewest other ids through
+  CanFilter filter() const {
+    uint32_t ids[Slots];
+    size_t n = 0;
+    for (const auto& slot : slots) {
+      if (slot.handler == nullptr) {
+        continue;
+      }
+      if (slot.key & can_dispatch_extended) {
+        return {0, 0xFFFFFFFF, true};  // extended ids need the single filter, keep it simple and accept all
+      }
+      ids[n++] = slot.key;
+    }
+    if (n == 0) {
+      return {0, 0xFFFFFFFF, true};
+    }
+    uint32_t all_and = 0x7FF, all_or = 0;
+    for (size_t i = 0; i < n; i++) {
+      all_and &= ids[i];
+      all_or |= ids[i];
+    }
+    CanFilter best{all_and << 21, ((all_and ^ all_or) << 21) | 0x1FFFFF, true};
+    uint32_t best_accepted = 1UL << __builtin_popcount(all_and ^ all_or);
+    // group membership bit per id, id 0 always in group one so every split is only tried once
+    for (uint32_t split = 1; n > 1 && split < (1UL << (n - 1)); split++) {
+      uint32_t and_1 = 0x7FF, or_1 = 0, and_2 = 0x7FF, or_2 = 0;
+      for (size_t i = 0; i < n; i++) {
+        if (i > 0 && (split >> (i - 1)) & 1) {
+          and_2 &= ids[i];
+          or_2 |= ids[i];
+        } else {
+          and_1 &= ids[i];
+          or_1 |= ids[i];
+        }
+      }
+      const uint32_t accepted =
+          (1UL << __builtin_popcount(and_1 ^ or_1)) + (1UL << __builtin_popcount(and_2 ^ or_2));
+      if (accepted < best_accepted) {
+        best_accepted = accepted;
+        // per filter: 11 bit id, rtr and a data nibble, rtr and data are don't care
+        best = {(and_1 << 21) | (and_2 << 5), ((and_1 ^ or_1) << 21) | (0x1FU << 16) | ((and_2 ^ or_2) << 5) | 0x1F,
+                false};
+      }
+    }
+    return best;
+  }
+
+ private:
+  struct Slot {
+    uint32_t key;
+    Handler handler;
+  };
+
+  Slot slots[Slots]{};
+  size_t count = 0;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include "hal.h"
+#include "main_vars.h"
+#include "spsc_ring.h"
+#include "telemetry.h"
+
+struct CanEvent {
+  enum Kind : uint8_t { value_float, value_uint, inverter_type, log };
+  Kind kind;
+  Telemetry::Id id;
+  union {
+    float f;
+    uint32_t u;
+    const char* text;  // static strings only
+  };
+  CanFrame frame;  // inverter_type only
+};
+
+class Battery;
+
+// hands decoded telemetry and log lines from the can side (own task on the esp32) to the mqtt side,
+// post*() must only be called from the can side and dispatch() only from the mqtt side
+class CanEvents {
+ public:
+  explicit CanEvents(Battery& battery) : battery(battery) {}
+
+  void publish(Telemetry::Id id, float value);
+  void publish(Telemetry::Id id, uint32_t value);
+  void inverterType(const CanFrame& frame);
+  void log(const char* text);
+  void dispatch();
+
+  uint32_t dropped = 0;  // events lost because the mqtt side fell behind
+
+ private:
+  Battery& battery;
+  SpscRing<CanEvent, can_event_queue_size> events;
+  void post(const CanEvent& event);
+};
@@ -1,55 +1,101 @@
 #pragma once
 
-#include <Arduino.h>
-#include <driver/twai.h>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
 
-#include <map>
+#include "can_dispatch.h"
+#include "frame_scheduler.h"
+#include "hal.h"
+#include "main_vars.h"
+#include "soc_model.h"
+#include "telemetry.h"
 
 struct ValueConfig {
   float* valuePtr;
   float defaultValue;
 };
 
+class Battery;
+
 class CanManager {
  public:
   static constexpr uint32_t CAN_EXTENDED = 0x80000000;
   static constexpr uint32_t CAN_REMOTE_REQUEST = 0x40000000;
+  using Handler = CanDispatcher<can_dispatch_slots, CanManager>::Handler;
 
-  static void init();
-  static bool send(uint32_t id, uint8_t len, uint8_t* buf);
-  static void loop();
-  static void readMessage(const twai_message_t& message);
+  explicit CanManager(Battery& battery);
 
-  static std::map<String, ValueConfig> value_map;
+  void init();
+  bool send(uint32_t id, uint8_t len, uint8_t* buf, bool periodic = false, bool urgent = false,
+            unsigned long origin_us = 0);
+  void loop();  // mqtt side, also services the bus when there is no can task
+  void readMessage(const CanFrame& message);
+  // call before init(), the acceptance filter is derived from the registered ids
+  bool registerHandler(uint32_t id, Handler handler);
+  // mqtt side, phase_ms ~0UL keeps the staggered phase
+  bool configureSchedule(uint32_t id, unsigned long period_ms, unsigned long phase_ms = ~0UL);
+  bool resetSchedule(uint32_t id);
+  void triggerLimits();        // any side, 0x110 goes out now instead of on its next slot
+  void setSoc(float percent);  // any side, the can task takes it over before it handles the next frame
 
   static float number_of_cells;
 
-  static float limit_battery_voltage_max;
-  static float limit_battery_voltage_min;
-  static float limit_discharge_current_max;
-  static float limit_charge_current_max;
+  float limit_battery_voltage_max = 0;
+  float limit_battery_voltage_min = 0;
+  float limit_discharge_current_max = 0;
+  float limit_charge_current_max = 0;
+  float effective_discharge_current_max = 0;  // limits actually sent, zeroed on missed master heartbeat
+  float effective_charge_current_max = 0;
+
+  float battery_voltage = 0;
+  float battery_current = 0;
+  float battery_temp = 0;
+
+  float cell_temp_max = 0;
+  float cell_temp_min = 0;
 
-  static float battery_voltage;
-  static float battery_current;
-  static float battery_temp;
+  float soc_percent = 0;
+  float soh_percent = 0;
+  float remaining_capacity_ah = 0;
+  float full_capacity_ah = 0;
 
-  static float cell_temp_max;
-  static float cell_temp_min;
+  float inverter_battery_voltage = 0;
+  float inverter_battery_current = 0;
+  float inverter_temperature = 0;
+  float inverter_soc = 0;
+  uint32_t inverter_timestamp = 0;
 
-  static float soc_percent;
-  static float soh_percent;
-  static float remaining_capacity_ah;
-  static float full_capacity_ah;
+  const ValueConfig settings[Telemetry::count];  // values settable over mqtt, valuePtr null if read only
+  SocModel soc_model;
 
  private:
-  static bool init_failed;
-  static unsigned long last_successful_send;
-  static unsigned long last_send_2s;
-  static unsigned long last_send_10s;
-  static unsigned long last_send_60s;
-  static void sendLimits();
-  static void sendStates();
-  static void sendBatteryInfo();
-  static void sendCellInfo();
-  static void sendAlarm();
+  Battery& battery;
+  Hal& hal;
+  bool init_failed = false;
+  bool task_running = false;
+  bool heartbeat_lost = false;      // as last reflected in 0x110
+  std::atomic<float> soc_set{NAN};  // master correction the can task has not taken over yet, NaN if none
+  unsigned long last_successful_send = 0;
+  unsigned long last_stats_time = 0;
+  CanDispatcher<can_dispatch_slots, CanManager> dispatcher;
+  FrameScheduler scheduler;
+  template <void (CanManager::*Send)()>
+  static void scheduled(void* can, bool, unsigned long) {
+    (static_cast<CanManager*>(can)->*Send)();
+  }
+  static void task(void* arg);
+  void publishStats();
+  void service(unsigned long alert_timeout_ms);
+  unsigned long untilNextSend();
+  bool heartbeatLost() const;
+  void sendLimits(bool triggered, unsigned long trigger_us);
+  void sendStates();
+  void sendBatteryInfo();
+  void sendCellInfo();
+  void sendAlarm();
+  static void onInverterBattery(CanManager& can, const CanFrame& message);
+  static void onInverterSoc(CanManager& can, const CanFrame& message);
+  static void onInverterTimestamp(CanManager& can, const CanFrame& message);
+  static void onInverterInfoRequest(CanManager& can, const CanFrame& message);
 };
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+#include "main_vars.h"
+#include "spsc_ring.h"
+
+// 0 = compiled out, 1 = unknown frames only, 2 = every rx/tx frame; the board envs build with 1
+#ifndef CAN_TRACE_LEVEL
+#define CAN_TRACE_LEVEL 2
+#endif
+
+struct TraceRecord {
+  uint32_t time_us;
+  uint32_t id;
+  uint8_t kind;
+  uint8_t len;
+  uint8_t flags;  // bit 0 extended, bit 1 remote request
+  uint8_t data[8];
+};
+
+// renders the frame in candump notation ("ID#DATA"), buf needs at least 9 + 1 + 2 * 8 + 1 chars
+void formatFrame(const CanFrame& frame, char* buf, size_t size);
+// inverse of formatFrame, also takes "ID#R" remote requests and a trailing line end, false for anything else
+// ("123#GG", odd nibbles, more than 8 bytes), data past len is zeroed
+bool parseFrame(const char* text, CanFrame& frame);
+
+class Battery;
+
+// binary frame tracer: the can side only copies a record into a ring, formatting happens later on the mqtt side,
+// streamed to serial when idle and kept in a capture ring that can be dumped over mqtt on request
+class CanTrace {
+ public:
+  enum Kind : uint8_t { rx, tx, rx_unknown };
+  enum DumpFormat : uint8_t { text, candump };
+
+  explicit CanTrace(Battery& battery);
+
+  void record(const Kind kind, const CanFrame& frame) {
+#if CAN_TRACE_LEVEL >= 2
+    push(kind, frame);
+#elif CAN_TRACE_LEVEL >= 1
+    if (kind == rx_unknown) {
+      push(kind, frame);
+    }
+#endif
+  }
+
+  void poll();  // mqtt side, drains the ring, starts a requested dump and feeds it
+  // requests publishing the capture, text to the trace topic or candump -L lines ("rx"/"tx" as interface,
+  // seconds since boot) to the candump topic, a few lines per poll() so the mqtt queue is not flooded,
+  // safe from any task: only a flag is set here, the next poll() starts the dump
+  void dump(DumpFormat format = text) { dump_request.store(format + 1, std::memory_order_release); }
+
+  bool serial_enabled = false;  // trace on / off, every line costs the loop task its time on the uart
+  uint32_t dropped = 0;
+
+ private:
+  Battery& battery;
+  Hal& hal;
+  SpscRing<TraceRecord, can_trace_queue_size> records;
+  TraceRecord capture[can_capture_size];
+  uint32_t capture_total = 0;  // records ever captured, record n lives at n % can_capture_size
+  std::atomic<uint8_t> dump_request{0};  // 0 = none, else DumpFormat + 1
+  uint32_t dump_next = 0;
+  uint32_t dump_end = 0;
+  DumpFormat dump_format = text;
+  uint64_t dump_time_us = 0;
+  uint32_t dump_last_us = 0;
+  void startDump(DumpFormat format);
+  void dumpNext();
+  void push(Kind kind, const CanFrame& frame);
+  static void format(const TraceRecord& record, char* buf, size_t size);
+};
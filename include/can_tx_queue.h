@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+#include "main_vars.h"
+
+struct CanTxStats {
+  uint32_t sent;
+  uint32_t failed_attempts;        // single-shot attempts the controller reported as failed (no ack, arbitration, ...)
+  uint32_t dropped_stale;          // deadline passed before the frame made it onto the bus
+  uint32_t dropped_attempts;       // can_tx_max_attempts failed, e.g. no other node acks
+  uint32_t dropped_full;
+  uint32_t superseded;             // periodic frames replaced by a fresher copy before they were sent
+  uint32_t last_latency_us;        // enqueue to tx success
+  uint32_t max_latency_us;
+  uint32_t avg_latency_us;         // moving average over ~16 frames
+  uint32_t urgent_sent;
+  uint32_t urgent_latency_max_us;  // origin (e.g. the mqtt command) to tx success
+  uint32_t urgent_latency_avg_us;
+};
+
+// transmit scheduler in front of the driver: frames wait here with a deadline, exactly one is handed to the
+// controller as single-shot attempt at a time and the tx success/failed alerts advance the queue, failed attempts
+// are retried with exponential backoff, no caller ever blocks on the bus
+class CanTxQueue {
+ public:
+  // urgent frames are attempted before everything else, their latency counts from origin_us
+  bool push(const CanFrame& frame, bool periodic, unsigned long now_us, bool urgent = false,
+            unsigned long origin_us = 0);
+  // drops stale frames and returns the next frame due for an attempt, nullptr while one is in flight or none is due
+  const CanFrame* next(unsigned long now_us);
+  void submitted(bool accepted, unsigned long now_us);  // result of handing next() to the driver
+  void completed(bool success, unsigned long now_us);   // tx success / failed alert
+  unsigned long untilNextAttemptUs(unsigned long now_us) const;
+  bool inFlight() const { return in_flight >= 0; }
+  const CanFrame* inFlightFrame() const { return in_flight >= 0 ? &entries[in_flight].frame : nullptr; }
+  size_t size() const { return count; }
+
+  CanTxStats stats{};
+
+ private:
+  struct Entry {
+    CanFrame frame;
+    unsigned long queued_us;
+    unsigned long due_us;
+    unsigned long origin_us;
+    uint8_t attempts;
+    bool periodic;
+    bool urgent;
+  };
+
+  Entry entries[can_tx_queue_size];
+  size_t count = 0;
+  int in_flight = -1;
+  unsigned long in_flight_since_us = 0;
+
+  void remove(size_t index);
+  void retryLater(size_t index, unsigned long now_us);
+};
@@ -1,10 +1,30 @@
 #pragma once
 
-#include <Arduino.h>
+#include <cstdint>
+
+#include "can_tx_queue.h"
+#include "hal.h"
+
+class Battery;
 
 class ESP32Can {
  public:
-  static bool init();
-  static bool send(uint32_t id, uint8_t len, const uint8_t* buf);
-  static void loop();
+  explicit ESP32Can(Battery& battery);
+
+  bool init(const CanFilter& filter);
+  // queues the frame for transmission, periodic frames replace an older unsent copy with the same id, urgent ones
+  // jump the queue and count their latency from origin_us
+  bool send(uint32_t id, uint8_t len, const uint8_t* buf, bool periodic = false, bool urgent = false,
+            unsigned long origin_us = 0);
+  void loop(unsigned long alert_timeout_ms = 0);  // blocks up to alert_timeout_ms for alerts
+  unsigned long untilNextTxMs();
+  const CanTxStats& txStats() const { return tx_queue.stats; }
+  const CanStatus& lastStatus() const { return status; }
+
+ private:
+  Battery& battery;
+  Hal& hal;
+  CanTxQueue tx_queue;
+  CanStatus status{};
+  void pumpTx();
 };
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// decimal rendering of scaled integers (e.g. 2153 with 1 decimal -> "215.3") using integer math only, the soft
+// float printf path is by far the most expensive part of a publish on the esp32-c3
+
+constexpr uint32_t decimalScale(const uint8_t exponent) { return exponent == 0 ? 1 : 10 * decimalScale(exponent - 1); }
+
+// value * 10^decimals rounded half away from zero and clamped to int32, the only float operation on the way
+inline int32_t toScaled(const float value, const uint8_t decimals) {
+  const float scaled = value * static_cast<float>(decimalScale(decimals));
+  if (scaled >= 2147483520.f) return INT32_MAX;
+  if (scaled <= -2147483520.f) return INT32_MIN;
+  return static_cast<int32_t>(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+// value of a single hex digit, -1 for anything else (can ids in topics and candump text)
+constexpr int hexDigit(const char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// inverse of formatFixed for payloads: optional sign, digits and an optional fraction, no exponent or spaces, digits
+// past decimals round half away from zero, false for anything else and for values outside int32
+constexpr bool parseFixed(const std::string_view text, const uint8_t decimals, int32_t& scaled) {
+  const bool negative = !text.empty() && text[0] == '-';
+  size_t pos = !text.empty() && (text[0] == '-' || text[0] == '+') ? 1 : 0;
+  uint64_t magnitude = 0;
+  uint8_t fraction = 0;
+  size_t digits = 0;
+  bool point = false;
+  int dropped = -1;  // first digit past decimals, decides the rounding
+  for (; pos < text.size(); pos++) {
+    const char c = text[pos];
+    if (c == '.' && !point) {
+      point = true;
+      continue;
+    }
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    digits++;
+    if (point && fraction == decimals) {
+      dropped = dropped < 0 ? c - '0' : dropped;
+      continue;
+    }
+    magnitude = magnitude * 10 + static_cast<uint64_t>(c - '0');
+    fraction += point;
+    if (magnitude > 0xFFFFFFFFULL) {
+      return false;
+    }
+  }
+  if (digits == 0) {
+    return false;
+  }
+  for (; fraction < decimals; fraction++) {
+    magnitude *= 10;
+    if (magnitude > 0xFFFFFFFFULL) {
+      return false;
+    }
+  }
+  magnitude += dropped >= 5;
+  if (magnitude > (negative ? 0x80000000ULL : 0x7FFFFFFFULL)) {
+    return false;
+  }
+  scaled = static_cast<int32_t>(negative ? -static_cast<int64_t>(magnitude) : static_cast<int64_t>(magnitude));
+  return true;
+}
+
+// writes the number and a terminating zero, returns its length or 0 if buf is too small (buf[0] is then zero)
+inline size_t formatFixed(const int32_t scaled, const uint8_t decimals, char* buf, const size_t size) {
+  char digits[24];  // reversed, at most 10 digits plus leading zeros for up to 9 decimals
+  size_t count = 0;
+  uint32_t magnitude = scaled < 0 ? 0U - static_cast<uint32_t>(scaled) : static_cast<uint32_t>(scaled);
+  do {
+    digits[count++] = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude != 0 || count <= decimals);
+  const size_t length = count + (scaled < 0) + (decimals > 0);
+  if (length + 1 > size) {
+    if (size > 0) buf[0] = '\0';
+    return 0;
+  }
+  size_t pos = 0;
+  if (scaled < 0) {
+    buf[pos++] = '-';
+  }
+  while (count > 0) {
+    buf[pos++] = digits[--count];
+    if (count == decimals && decimals > 0) {
+      buf[pos++] = '.';
+    }
+  }
+  buf[pos] = '\0';
+  return pos;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "main_vars.h"
+
+struct ScheduleStats {
+  uint32_t runs;
+  uint32_t skipped;        // whole periods missed because the task was too late
+  uint32_t jitter_max_us;  // lateness against the ideal due time
+  uint32_t jitter_avg_us;  // moving average over ~16 runs
+  uint32_t triggered;      // runs asked for by trigger(), on or off the grid
+};
+
+// periodic frame scheduler: every frame id has its own period and phase, due times advance by whole periods so
+// lateness never accumulates, and the phases are staggered so frames with a common period do not go out as a burst.
+// trigger() asks for an extra run right away, e.g. after a value changed, at most one per can_trigger_min_spacing_ms.
+// run()/untilNextUs() belong to the can side, configure()/reset()/trigger() may be called from the mqtt side.
+class FrameScheduler {
+ public:
+  // trigger_us: when the run was asked for, only meaningful if triggered
+  using Send = void (*)(void* context, bool triggered, unsigned long trigger_us);
+
+  struct Task {
+    uint32_t id;
+    Send send;
+    void* context;
+    unsigned long default_period_ms;
+    uint64_t stagger_us;  // phase picked by start()
+    uint64_t period_us;
+    uint64_t phase_us;
+    uint64_t due_us;
+    uint64_t last_run_us;
+    ScheduleStats stats;
+    // written by configure(), picked up by the can side on the next run()
+    std::atomic<bool> pending;
+    unsigned long pending_period_ms;
+    unsigned long pending_phase_ms;
+    std::atomic<bool> triggered;
+    std::atomic<unsigned long> trigger_us;
+  };
+
+  bool add(uint32_t id, Send send, void* context, unsigned long period_ms);
+  void start(unsigned long now_us);  // staggers the phases and schedules the first runs
+  void run(unsigned long now_us);    // sends everything that is due
+  unsigned long untilNextUs(unsigned long now_us) const;
+  // phase_ms counts from start(), ~0UL keeps the staggered phase, periods under can_schedule_min_period_ms fail
+  bool configure(uint32_t id, unsigned long period_ms, unsigned long phase_ms = ~0UL);
+  bool reset(uint32_t id);
+  bool trigger(uint32_t id, unsigned long now_us);
+  const Task* find(uint32_t id) const;
+  size_t size() const { return count; }
+  const Task& operator[](const size_t i) const { return tasks[i]; }
+
+ private:
+  Task tasks[can_schedule_size]{};
+  size_t count = 0;
+  uint64_t start_us = 0;
+  uint64_t last_us = 0;
+  void apply(Task& task, uint64_t now);
+  uint64_t extend(unsigned long now_us) const;
+};
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+struct CanFrame {
+  uint32_t id;
+  uint8_t len;
+  bool extd;
+  bool rtr;
+  uint8_t data[8];
+};
+
+struct CanStatus {
+  uint32_t msgs_to_rx;
+  uint32_t rx_missed_count;
+  uint32_t rx_overrun_count;
+  uint32_t bus_error_count;
+};
+
+// TWAI acceptance filter layout, mask bits set are don't care
+struct CanFilter {
+  uint32_t acceptance_code;
+  uint32_t acceptance_mask;
+  bool single_filter;
+};
+
+// driver independent alert bits, the esp32 backend maps the TWAI_ALERT_* flags onto these
+enum CanAlert : uint32_t {
+  CAN_ALERT_RX_DATA = 1UL << 0,
+  CAN_ALERT_ERR_PASS = 1UL << 1,
+  CAN_ALERT_BUS_ERROR = 1UL << 2,
+  CAN_ALERT_RX_QUEUE_FULL = 1UL << 3,
+  CAN_ALERT_TX_SUCCESS = 1UL << 4,
+  CAN_ALERT_TX_FAILED = 1UL << 5,
+};
+
+class Clock {
+ public:
+  virtual ~Clock() = default;
+  virtual unsigned long millis() = 0;
+  virtual unsigned long micros() = 0;
+};
+
+class CanDriver {
+ public:
+  virtual ~CanDriver() = default;
+  virtual bool begin(const CanFilter& filter) = 0;
+  // queues one single-shot attempt without blocking, the outcome arrives as CAN_ALERT_TX_SUCCESS / _TX_FAILED
+  virtual bool transmit(const CanFrame& frame) = 0;
+  virtual bool receive(CanFrame& frame) = 0;  // non-blocking, data past len is zeroed
+  virtual uint32_t readAlerts(unsigned long timeout_ms) = 0;
+  virtual void getStatus(CanStatus& status) = 0;
+};
+
+class MqttClient {
+ public:
+  using ConnectCallback = std::function<void(bool session_present)>;
+  using MessageCallback = std::function<void(char* topic, char* payload, int retain, int qos, bool dup)>;
+
+  virtual ~MqttClient() = default;
+  virtual void begin(const char* server, const char* user, const char* password, const char* will_topic,
+                     ConnectCallback on_connect, MessageCallback on_message) = 0;
+  virtual bool connected() = 0;
+  virtual void publish(const char* topic, const char* payload, bool retain) = 0;
+  virtual void subscribe(const char* topic) = 0;
+};
+
+class Logger {
+ public:
+  virtual ~Logger() = default;
+  virtual void write(const char* text) = 0;
+  void printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  void println(const char* text);
+};
+
+struct BoardInfo {
+  char wifi[33];
+  char ip[16];
+  char sdk[32];
+  char cpu[64];
+  char flash[32];
+  char heap[16];
+  char psram[16];
+};
+
+struct MemoryInfo {
+  uint32_t free_heap;
+  uint32_t largest_free_block;
+  uint32_t min_free_heap;  // low water mark since boot
+};
+
+class Board {
+ public:
+  virtual ~Board() = default;
+  virtual void restart() = 0;
+  virtual void setLed(bool on) = 0;
+  virtual const char* hostname() = 0;
+  virtual void getInfo(BoardInfo& info) = 0;
+  virtual void getMemory(MemoryInfo& memory) = 0;
+  virtual uint32_t stackFree() = 0;  // low water mark of the calling task's stack in bytes, 0 if not known
+  // runs fn(arg) in its own task until fn returns, returns false if the backend has no tasks and the caller has to
+  // poll instead
+  virtual bool startTask(void (*fn)(void*), const char* name, uint32_t stack_size, uint8_t priority, void* arg) = 0;
+};
+
+// firmware image download in pieces, driven chunk by chunk from the ota task (or polled): begin() connects and
+// prepares the update partition, read() hands out what arrived of the image so far and write() flashes it
+class Updater {
+ public:
+  virtual ~Updater() = default;
+  virtual bool begin(const char* path, uint32_t& size, char* message, size_t message_size) = 0;
+  virtual int read(uint8_t* buffer, size_t size) = 0;  // 0 = nothing arrived yet, < 0 = connection lost
+  virtual bool write(const uint8_t* buffer, size_t size) = 0;
+  // commit: verify and boot the image on the next restart, otherwise drop it, message receives the result
+  virtual bool end(bool commit, char* message, size_t message_size) = 0;
+};
+
+// small key -> blob store in flash (nvs on the esp32), every save is a flash write so callers batch and coalesce
+class Storage {
+ public:
+  virtual ~Storage() = default;
+  virtual bool load(const char* key, void* data, size_t size) = 0;  // false if missing or of another size
+  virtual bool save(const char* key, const void* data, size_t size) = 0;
+};
+
+struct Hal {
+  Clock* clock;
+  CanDriver* can;
+  MqttClient* mqtt;
+  Logger* log;
+  Board* board;
+  Storage* storage;
+  Updater* updater;
+};
+
+// defined by the selected backend (src/esp32/ or src/native/)
+extern Hal hal;
@@ -1,13 +1,77 @@
 #pragma once
 
-#include <Arduino.h>
+#include <cstdint>
 
 constexpr uint8_t fw_major_version = 0x03;
 constexpr uint8_t fw_minor_version = 0x16;
 
 constexpr const char* mqtt_topic = "master/can/";
 constexpr const char* mqtt_master_heartbeat_topic = "master/uptime";
-constexpr unsigned int max_mqtt_send_queue = 100;
+constexpr unsigned int max_mqtt_send_queue = 80;
+constexpr unsigned int max_mqtt_topic_length = 64;
+constexpr unsigned int max_mqtt_payload_length = 112;  // longest queued producer, the unknown/frames dump line
+constexpr unsigned int max_mqtt_interned_topics = 32;
+constexpr unsigned int mqtt_drain_max_messages = 8;            // per loop() call, 0 = no limit
+constexpr unsigned long mqtt_drain_budget_us = 2000UL;         // per loop() call, 0 = no limit
+constexpr unsigned int mqtt_inbound_queue_size = 8;            // power of two, commands from the client task for loop()
+constexpr unsigned int max_mqtt_inbound_payload_length = 128;  // longest command payload, an ota path
+
+constexpr unsigned int can_event_queue_size = 64;  // power of two
+constexpr uint32_t can_task_stack_size = 4096;
+constexpr uint8_t can_task_priority = 5;                     // above the arduino loop task
+constexpr unsigned long can_task_max_wait_ms = 20UL;         // also how long a trigger from the mqtt side may wait
+constexpr unsigned int can_dispatch_slots = 16;              // power of two, at most half of them used
+constexpr unsigned int can_schedule_size = 8;                // periodic frames
+constexpr unsigned long can_schedule_min_period_ms = 10UL;   // shortest period schedule/<id>/set accepts
+constexpr unsigned long can_trigger_min_spacing_ms = 100UL;  // between out of cycle sends of one frame
+constexpr bool can_hw_filter = true;                         // false = accept all frames, e.g. to sniff unknown traffic
+
+constexpr unsigned int can_trace_queue_size = 64;  // power of two
+constexpr unsigned int can_capture_size = 256;          // frames kept for dumps, 20 bytes each
+constexpr unsigned int can_capture_dump_per_poll = 4;   // dump lines queued per loop() call
+constexpr unsigned int can_trace_poll_max = 16;  // records formatted per loop() call
+
+constexpr unsigned int can_unknown_slots = 64;  // power of two, distinct unknown ids tracked, at most 3/4 of them used
+constexpr unsigned long can_unknown_digest_interval_ms = 60UL * 1000UL;  // 0 = no digest, unknown/dump still works
+constexpr unsigned int can_unknown_digest_top = 4;                       // busiest ids listed in the digest
+
+constexpr unsigned int can_tx_queue_size = 16;
+constexpr unsigned long can_tx_deadline_ms = 1000UL;  // frames older than this are dropped
+constexpr uint8_t can_tx_max_attempts = 8;
+constexpr unsigned long can_tx_retry_base_us = 1000UL;  // doubled after every failed attempt
+constexpr unsigned long can_tx_retry_max_us = 100UL * 1000UL;
+constexpr unsigned long can_tx_in_flight_timeout_us = 50UL * 1000UL;
+
+constexpr uint32_t can_bitrate = 500000UL;  // as set up in the twai driver, for the bus load estimate
+
+constexpr unsigned long bus_monitor_interval_ms = 10UL * 1000UL;  // one summary on the bus topic each
+constexpr unsigned int bus_monitor_ids = 16;                      // further ids only count as other
+constexpr uint32_t bus_alarm_errors_per_s = 1;                    // bus errors + lost rx frames
+constexpr uint8_t bus_alarm_load_percent = 70;
+constexpr uint8_t bus_alarm_rx_drop_percent = 50;                 // against the rx rate of the interval before
+
+constexpr unsigned long publish_min_interval_ms = 1000UL;
+constexpr unsigned long publish_refresh_interval_ms = 60UL * 1000UL;
+constexpr unsigned long stats_interval_ms = 60UL * 1000UL;
+constexpr bool telemetry_snapshot = false;  // default mode, true = snapshot and per topic, telemetry/mode/set to change
+constexpr unsigned long telemetry_snapshot_interval_ms = 2UL * 1000UL;  // fastest can cycle
+constexpr unsigned long metrics_interval_ms = 60UL * 1000UL;  // 0 = off, metrics/interval/set at runtime
+
+constexpr bool soc_model = false;                             // soc follows the 0x91 current, soc_model/enabled/set
+constexpr float soc_model_current_sign = 1.f;                 // -1 if the inverter reports charging as negative
+constexpr unsigned long soc_model_max_gap_ms = 5UL * 1000UL;  // longer 0x91 gaps are not integrated
+
+constexpr unsigned long settings_flush_quiet_ms = 30UL * 1000UL;            // no */set for this long: write to flash
+constexpr unsigned long settings_flush_min_interval_ms = 60UL * 1000UL;     // significant changes, at most this often
+constexpr unsigned long settings_flush_max_delay_ms = 15UL * 60UL * 1000UL;  // values that never settle, e.g. soc
+
+constexpr unsigned int ota_chunk_size = 1024;                  // bytes moved per step, bounds a polled loop() call
+constexpr unsigned int max_ota_path_length = 128;
+constexpr uint32_t ota_task_stack_size = 12288;                // tls handshake and cert check, 8 KB loop task + margin
+constexpr uint32_t ota_task_min_stack_free = 1024;             // less left at the end of an update is logged
+constexpr uint8_t ota_task_priority = 1;                       // like the arduino loop task, below the can task
+constexpr unsigned long ota_stall_timeout_ms = 12UL * 1000UL;  // no image data for this long aborts the update
+constexpr uint8_t ota_progress_step_percent = 10;
 
 constexpr unsigned int blink_time = 5U * 1000U;
 
@@ -18,6 +82,9 @@ constexpr unsigned long sntp_timeout_ms = 10UL * 1000UL;
 constexpr unsigned long wifi_timeout_ms = 30UL * 1000UL;
 constexpr unsigned int min_time_s = 24U * 60U * 60U;
 
+#ifdef ARDUINO
+#include <Arduino.h>
+
 #define LED_ON HIGH
 #define LED_OFF LOW
 
@@ -38,3 +105,4 @@ class MainVars {
  private:
   static String getMacAddress();
 };
+#endif
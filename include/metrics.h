@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+
+#include "hal.h"
+#include "main_vars.h"
+
+class Battery;
+
+// runtime instrumentation, snapshot published as json to the metrics topic every interval_ms, interval_ms 0 turns
+// sampling off and leaves a single branch per loop
+class Metrics {
+ public:
+  static constexpr unsigned int loop_buckets = 16;  // bucket i: loops shorter than 2^i us, the last one takes the rest
+
+  explicit Metrics(Battery& battery);
+
+  unsigned long loopStart() const { return interval_ms ? hal.clock->micros() : 0; }
+  void loopDone(const unsigned long start_us) {
+    if (interval_ms) {
+      recordLoop(hal.clock->micros() - start_us);
+    }
+  }
+  void loop();  // mqtt side, publishes the snapshot when due
+  void setInterval(unsigned long ms);
+
+  unsigned long interval_ms = metrics_interval_ms;
+
+ private:
+  Battery& battery;
+  Hal& hal;
+  uint32_t loop_histogram[loop_buckets]{};
+  uint32_t loop_count = 0;
+  uint32_t loop_max_us = 0;
+  unsigned long last_publish_time = 0;
+  void recordLoop(unsigned long duration_us);
+  void publish();
+};
@@ -1,27 +1,90 @@
 #pragma once
 
-#include <Arduino.h>
-#include <PsychicMqttClient.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "hal.h"
+#include "main_vars.h"
+#include "mqtt_queue.h"
+#include "spsc_ring.h"
+
+struct MqttQueueStats {
+  uint32_t drained_total;
+  uint32_t drain_calls;
+  uint16_t last_drained;      // messages published by the last loop() call
+  uint16_t last_depth;        // queue depth before the last drain
+  uint16_t depth_high_water;
+  uint32_t max_drain_us;      // longest single drain
+};
+
+// a message the client task received, copied so loop() can handle it after the client reused its buffers
+struct MqttInbound {
+  char topic[max_mqtt_topic_length];
+  char payload[max_mqtt_inbound_payload_length];
+};
+
+using TopicHandle = uint8_t;
+
+class Battery;
 
 class MqttManager {
  public:
-  static void init();
-  static void loop();
-  static void log(const String& line, bool async = true, int priority = 10);
-  static void publish(const String& topic, float value, bool retain = false, bool async = true, int priority = 0);
-  static void publish(const String& topic, uint32_t value, bool retain = false, bool async = true, int priority = 0);
-  static void publish(const String& topic, const String& payload, bool retain = false, bool async = true,
-                      int priority = 0);
-  static void subscribe(const String& topic);
-  static void publishInfos();
-  static unsigned long last_master_heartbeat_time;
+  static constexpr TopicHandle invalid_topic = 0xFF;
+
+  MqttManager(Battery& battery, const char* module_topic);
+
+  void init();     // topics only, publishing before connect() fills the queue
+  void connect();  // starts the client, it reconnects by itself from then on
+  // resolves module_topic + topic once, the handle then publishes without any string building
+  TopicHandle registerTopic(const char* topic);
+  void loop();
+  void log(const char* line, bool async = true, int priority = 10);
+  void publish(const char* topic, float value, bool retain = false, bool async = true, int priority = 0);
+  void publish(const char* topic, uint32_t value, bool retain = false, bool async = true, int priority = 0);
+  void publish(const char* topic, const char* payload, bool retain = false, bool async = true, int priority = 0);
+  void publish(TopicHandle topic, float value, bool retain = false, bool async = true, int priority = 0);
+  void publish(TopicHandle topic, uint32_t value, bool retain = false, bool async = true, int priority = 0);
+  void publish(TopicHandle topic, const char* payload, bool retain = false, bool async = true, int priority = 0);
+  void subscribe(const char* topic);
+  void publishInfos();
+  void publishBootTimeline();
+  size_t queueDepth() const { return messageQueue.size(); }
+  uint32_t queueEvicted() const { return messageQueue.evicted; }
+  uint32_t queueDropped() const { return messageQueue.dropped; }
+  uint32_t queueOversized() const { return messageQueue.oversized; }
+
+  std::atomic<unsigned long> last_master_heartbeat_time{0};  // read by the can task
+  std::atomic<uint32_t> inbound_dropped{0};                  // commands lost because loop() fell behind or too long
+  unsigned int drain_max_messages = mqtt_drain_max_messages;
+  unsigned long drain_budget_us = mqtt_drain_budget_us;
+  MqttQueueStats queue_stats{};
 
  private:
-  static PsychicMqttClient client;
-  static String module_topic;
-  static String will_topic;
-  static unsigned long last_blink_time;
-  static void onConnect(bool session_present);
-  static void onMessage(char* topic, char* payload, int retain, int qos, bool dup);
-  static void otaUpdate(const String& path);
+  enum class Control : uint8_t { ota, trace, blink, restart, telemetry_mode, metrics_interval, soc_model, unknown };
+
+  Battery& battery;
+  Hal& hal;
+  std::string module_topic;
+  std::string will_topic;
+  unsigned long last_blink_time = 0;
+  char topic_table[max_mqtt_interned_topics][max_mqtt_topic_length];
+  TopicHandle topic_count = 0;
+  TopicHandle log_topic = invalid_topic;
+  MqttSendQueue<max_mqtt_send_queue, max_mqtt_topic_length, max_mqtt_payload_length> messageQueue;
+  // the client runs its callbacks on its own task (esp-mqtt), they only hand over to loop() which owns everything
+  SpscRing<MqttInbound, mqtt_inbound_queue_size> inbound;
+  std::atomic<bool> connect_pending{false};
+  std::atomic<unsigned long> connected_us{0};
+  uint32_t inbound_dropped_logged = 0;
+  void receive(const char* topic, const char* payload);
+  void handleInbound();
+  void enqueue(const char* full_topic, const char* payload, bool retain, bool async, int priority);
+  void queued(const char* topic, const char* payload, uint32_t oversized_before);
+  void onConnect();
+  void onMessage(const char* topic, const char* payload);
+  void onControl(Control control, const char* payload, std::string_view sPayload);
+  void onSchedule(std::string_view id_text, const char* payload, bool isSet);
 };
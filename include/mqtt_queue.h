@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// fixed capacity priority queue for outgoing mqtt messages, all slots live in a preallocated pool and are linked
+// into a list ordered by priority (high first, fifo within equal priority), so pop and evicting the lowest
+// priority entry are O(1) and nothing is allocated after construction, not synchronized: push and pop from one
+// task only (MqttManager keeps it on the loop task)
+template <size_t Capacity, size_t TopicLength, size_t PayloadLength>
+class MqttSendQueue {
+ public:
+  struct Message {
+    const char* topic;  // interned full topic or topic_buffer
+    char topic_buffer[TopicLength];
+    char payload[PayloadLength];
+    int priority;
+    bool retain;
+    uint16_t prev;
+    uint16_t next;
+  };
+
+  static_assert(Capacity > 0 && Capacity < 0xFFFF, "capacity must fit the 16 bit slot links");
+
+  MqttSendQueue() {
+    for (size_t i = 0; i < Capacity; i++) {
+      slots[i].next = i + 1 < Capacity ? static_cast<uint16_t>(i + 1) : none;
+    }
+  }
+
+  // copies prefix + topic and payload into a free slot, evicts the lowest priority message when full,
+  // returns false if the message was dropped instead or does not fit a slot (never truncated)
+  bool push(const char* prefix, const char* topic, const char* payload, const bool retain, const int priority) {
+    const size_t prefix_length = strlen(prefix);
+    const size_t topic_length = strlen(topic);
+    const size_t payload_length = strlen(payload);
+    if (prefix_length + topic_length >= TopicLength || payload_length >= PayloadLength) {
+      oversized++;
+      return false;
+    }
+    Message* msg = acquire(priority);
+    if (msg == nullptr) {
+      return false;
+    }
+    memcpy(msg->topic_buffer, prefix, prefix_length);
+    memcpy(msg->topic_buffer + prefix_length, topic, topic_length + 1);
+    msg->topic = msg->topic_buffer;
+    return commit(msg, payload, payload_length, retain, priority);
+  }
+
+  // same for a full topic in static storage, only the pointer is kept
+  bool push(const char* interned_topic, const char* payload, const bool retain, const int priority) {
+    const size_t payload_length = strlen(payload);
+    if (payload_length >= PayloadLength) {
+      oversized++;
+      return false;
+    }
+    Message* msg = acquire(priority);
+    if (msg == nullptr) {
+      return false;
+    }
+    msg->topic = interned_topic;
+    return commit(msg, payload, payload_length, retain, priority);
+  }
+
+  const Message& front() const { return slots[head]; }
+
+  void pop() {
+    if (head != none) {
+      release(unlink(head));
+    }
+  }
+
+  bool empty() const { return head == none; }
+  size_t size() const { return count; }
+  static constexpr size_t capacity() { return Capacity; }
+
+  uint32_t evicted = 0;
+  uint32_t dropped = 0;
+  uint32_t oversized = 0;  // longer than a slot, a producer outgrew max_mqtt_payload_length
+
+ private:
+  static constexpr uint16_t none = 0xFFFF;
+
+  Message slots[Capacity];
+  uint16_t head = none;
+  uint16_t tail = none;
+  uint16_t free_head = 0;
+  size_t count = 0;
+
+  Message* acquire(const int priority) {
+    if (free_head == none) {
+      if (priority <= slots[tail].priority) {
+        dropped++;
+        return nullptr;
+      }
+      release(unlink(tail));  // delete lowest priority message
+      evicted++;
+    }
+    Message* msg = &slots[free_head];
+    free_head = msg->next;
+    return msg;
+  }
+
+  bool commit(Message* msg, const char* payload, const size_t payload_length, const bool retain, const int priority) {
+    memcpy(msg->payload, payload, payload_length + 1);
+    msg->priority = priority;
+    msg->retain = retain;
+    link(static_cast<uint16_t>(msg - slots));
+    return true;
+  }
+
+  // inserts behind the last entry with priority >= the new one, walking from the tail keeps the common
+  // case (low priority telemetry) O(1), and so does a new highest priority that goes straight to the head
+  void link(const uint16_t index) {
+    Message& msg = slots[index];
+    uint16_t after = head != none && slots[head].priority < msg.priority ? none : tail;
+    while (after != none && slots[after].priority < msg.priority) {
+      after = slots[after].prev;
+    }
+    msg.prev = after;
+    msg.next = after == none ? head : slots[after].next;
+    if (msg.next == none) {
+      tail = index;
+    } else {
+      slots[msg.next].prev = index;
+    }
+    if (after == none) {
+      head = index;
+    } else {
+      slots[after].next = index;
+    }
+    count++;
+  }
+
+  uint16_t unlink(const uint16_t index) {
+    const Message& msg = slots[index];
+    if (msg.prev == none) {
+      head = msg.next;
+    } else {
+      slots[msg.prev].next = msg.next;
+    }
+    if (msg.next == none) {
+      tail = msg.prev;
+    } else {
+      slots[msg.next].prev = msg.prev;
+    }
+    count--;
+    return index;
+  }
+
+  void release(const uint16_t index) {
+    slots[index].next = free_head;
+    free_head = index;
+  }
+};
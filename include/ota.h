@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "hal.h"
+#include "main_vars.h"
+
+class Battery;
+
+// firmware update in the background: the download is streamed in ota_chunk_size pieces from a low priority task
+// (or one chunk per loop() where there are no tasks), so the can task keeps every frame on its slot throughout.
+// progress and the result reach mqtt from loop(), the restart into the new image happens there as well
+class Ota {
+ public:
+  enum State : uint8_t { idle, connecting, downloading, done, failed };
+
+  explicit Ota(Battery& battery);
+
+  bool start(const char* path);  // mqtt side, false while an update is already running
+  void loop();                   // mqtt side
+  State state() const { return current.load(std::memory_order_acquire); }
+  uint32_t received() const { return received_bytes.load(std::memory_order_relaxed); }
+  uint32_t size() const { return image_size.load(std::memory_order_relaxed); }
+
+ private:
+  Battery& battery;
+  Hal& hal;
+  std::atomic<State> current{idle};
+  std::atomic<uint32_t> received_bytes{0};
+  std::atomic<uint32_t> image_size{0};
+  bool polled = false;             // no task, loop() steps; fixed before the task starts
+  unsigned long started_ms = 0;
+  unsigned long last_data_ms = 0;  // ota side
+  bool led = false;                // ota side
+  uint32_t stack_free = 0;         // ota task low water mark, written before done / failed
+  uint8_t reported_percent = 0;
+  char path[max_ota_path_length]{};
+  char message[max_mqtt_payload_length]{};  // result, written by the ota side before done / failed
+  uint8_t chunk[ota_chunk_size];
+  static void task(void* arg);
+  bool step();  // one chunk, false once the update is over
+  bool finish(bool ok);
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+constexpr uint32_t fnv1a(const std::string_view text, const uint32_t seed) {
+  uint32_t hash = 2166136261UL ^ seed;
+  for (const char c : text) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619UL;
+  }
+  return hash;
+}
+
+// collision free hash over a fixed key set, the seed is searched by the compiler so a lookup is one hash, one table
+// read and one compare against the only candidate key
+template <size_t N, size_t Slots>
+class PerfectHash {
+  static_assert(N < 0xFF && N <= Slots && (Slots & (Slots - 1)) == 0, "slot count must be a power of two");
+
+ public:
+  static constexpr uint8_t empty = 0xFF;
+  static constexpr uint32_t max_seed = 100000;
+
+  constexpr explicit PerfectHash(const std::array<std::string_view, N>& keys) : keys(keys) {
+    for (seed = 0; seed < max_seed; seed++) {
+      if (build()) {
+        return;
+      }
+    }
+  }
+
+  constexpr bool valid() const { return seed < max_seed; }
+
+  // index of key in the key array, -1 if it is not one of them
+  constexpr int find(const std::string_view key) const {
+    const uint8_t index = table[slot(key)];
+    return index != empty && keys[index] == key ? index : -1;
+  }
+
+ private:
+  std::array<std::string_view, N> keys;
+  std::array<uint8_t, Slots> table{};
+  uint32_t seed = 0;
+
+  // top bits after a final mix, the fnv multiply only carries upwards, so without it short keys that differ in
+  // one character (e.g. "rx" and "tx") share their top bits for every seed
+  constexpr size_t slot(const std::string_view key) const {
+    size_t bits = 0;
+    while ((size_t{1} << bits) < Slots) {
+      bits++;
+    }
+    uint32_t hash = fnv1a(key, seed);
+    hash = (hash ^ hash >> 16) * 0x85EBCA6BUL;
+    hash = (hash ^ hash >> 13) * 0xC2B2AE35UL;
+    hash ^= hash >> 16;
+    return bits == 0 ? 0 : hash >> (32 - bits);
+  }
+
+  constexpr bool build() {
+    for (auto& entry : table) {
+      entry = empty;
+    }
+    for (size_t i = 0; i < N; i++) {
+      uint8_t& entry = table[slot(keys[i])];
+      if (entry != empty) {
+        return false;
+      }
+      entry = static_cast<uint8_t>(i);
+    }
+    return true;
+  }
+};
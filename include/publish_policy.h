@@ -0,0 +1,51 @@
+#pragma once
+
+struct PublishPolicy {
+  double deadband;                    // minimum change against the last published value
+  unsigned long min_interval_ms;      // max rate, changes inside this window are held back until it ends
+  unsigned long refresh_interval_ms;  // republish unchanged values after this long, 0 = never
+};
+
+// per topic state deciding whether an offered value goes out
+class PublishFilter {
+ public:
+  bool shouldPublish(const double value, const unsigned long now, const PublishPolicy& policy) {
+    if (published) {
+      const unsigned long since_last = now - last_publish_ms;
+      const double change = value > last_value ? value - last_value : last_value - value;
+      // values are scaled integers carried in floats, tolerate the rounding of e.g. 215.4 - 215.3
+      const bool changed = change > 0 && change + 1e-4 >= policy.deadband;
+      const bool refresh = policy.refresh_interval_ms > 0 && since_last >= policy.refresh_interval_ms;
+      if (!refresh && (!changed || since_last < policy.min_interval_ms)) {
+        held = changed;  // a value back within the deadband has nothing left to send
+        held_value = value;
+        return false;
+      }
+    }
+    published = true;
+    held = false;
+    last_value = value;
+    last_publish_ms = now;
+    return true;
+  }
+
+  // true once for a held back change when its min_interval is over, the caller then publishes the latest value
+  bool flushDue(const unsigned long now, const PublishPolicy& policy) {
+    if (!held || now - last_publish_ms < policy.min_interval_ms) {
+      return false;
+    }
+    held = false;
+    last_value = held_value;
+    last_publish_ms = now;
+    return true;
+  }
+
+  void invalidate() { published = false; }
+
+ private:
+  double last_value = 0;
+  double held_value = 0;
+  unsigned long last_publish_ms = 0;
+  bool published = false;
+  bool held = false;
+};
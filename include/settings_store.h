@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "hal.h"
+#include "main_vars.h"
+#include "telemetry.h"
+
+struct SettingsStoreStats {
+  uint32_t flushes;
+  uint32_t failed;
+  uint32_t coalesced;  // changes that never reached flash on their own
+};
+
+class Battery;
+
+// keeps the mqtt settable values across reboots: changes are only noted in ram and the whole set goes to flash as
+// one blob once the values were quiet for a while, or sooner when they moved a lot, so a stream of */set commands
+// costs one flash write instead of one per command
+class SettingsStore {
+ public:
+  explicit SettingsStore(Battery& battery);
+
+  bool load();   // one read of the blob over the defaults, false if nothing (valid) was stored
+  void loop();   // mqtt side, notes changes and flushes when due
+  bool flush();  // writes pending changes now, also called right before a restart
+
+  SettingsStoreStats stats{};
+
+ private:
+  struct Blob {
+    uint32_t magic;
+    float values[Telemetry::count];
+  };
+
+  Battery& battery;
+  Hal& hal;
+  float stored[Telemetry::count]{};  // what flash holds, or the defaults before the first flush
+  float seen[Telemetry::count]{};    // values as of the last loop()
+  bool dirty = false;
+  bool significant = false;
+  unsigned long dirty_since = 0;
+  unsigned long last_change = 0;
+  unsigned long last_flush = 0;
+  void snapshot(float* values) const;
+};
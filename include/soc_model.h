@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+
+#include "main_vars.h"
+
+// coulomb counter: integrates the battery current between two samples, so the soc follows the inverter within one
+// 0x91 frame instead of waiting for the master, soc values the master sets in between are taken over as corrections
+class SocModel {
+ public:
+  // current_a positive charges the battery, returns the new soc in percent (soc_percent unchanged without capacity)
+  float update(const float soc_percent, const float current_a, const float full_capacity_ah,
+               const unsigned long now_us) {
+    if (full_capacity_ah <= 0) {
+      sampled = false;
+      return soc_percent;
+    }
+    if (soc_percent != last_soc || !sampled) {
+      charge_ah = static_cast<double>(soc_percent) / 100 * full_capacity_ah;  // correction or first sample
+    } else {
+      const unsigned long dt_us = now_us - last_us;
+      if (dt_us <= soc_model_max_gap_ms * 1000UL) {  // after a gap the current in between is unknown
+        charge_ah += static_cast<double>(current_a) * dt_us / 3.6e9;
+      }
+    }
+    if (charge_ah < 0) {
+      charge_ah = 0;
+    } else if (charge_ah > full_capacity_ah) {
+      charge_ah = full_capacity_ah;
+    }
+    sampled = true;
+    last_us = now_us;
+    last_soc = static_cast<float>(charge_ah / full_capacity_ah * 100);
+    return last_soc;
+  }
+
+  void stop() { sampled = false; }  // while disabled, the next update starts from the soc as it is then
+
+  std::atomic<bool> enabled{soc_model};  // switched from the mqtt side
+
+ private:
+  double charge_ah = 0;  // double, a few mAs per frame vanish in a float of ~100 Ah
+  float last_soc = 0;    // what we wrote, anything else in soc_percent came from the master
+  unsigned long last_us = 0;
+  bool sampled = false;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "hal.h"
+#include "publish_policy.h"
+
+struct PublishStats {
+  uint32_t offered;
+  uint32_t published;
+  uint32_t suppressed;
+  uint32_t snapshots;
+};
+
+class Battery;
+
+// fixed telemetry set, every value passes its publish policy before it reaches the mqtt queue, or / and all latest
+// values go out together as one json snapshot on the telemetry topic
+class Telemetry {
+ public:
+  enum Mode : uint8_t { topics, snapshot, both };
+
+  enum Id : uint8_t {
+    limits_max_voltage,
+    limits_min_voltage,
+    limits_max_discharge_current,
+    limits_max_charge_current,
+    battery_voltage,
+    battery_current,
+    battery_temp,
+    battery_max_cell_temp,
+    battery_min_cell_temp,
+    battery_soc,
+    battery_soh,
+    battery_remaining_capacity_ah,
+    battery_full_capacity_ah,
+    inverter_battery_voltage,
+    inverter_battery_current,
+    inverter_temperature,
+    inverter_soc,
+    inverter_timestamp,
+    count
+  };
+
+  explicit Telemetry(Battery& battery);
+
+  void init();  // interns the full topics, call once module_topic is known
+  void publish(Id id, float value);
+  void publish(Id id, uint32_t value);
+  void invalidate();  // publish everything again on the next offer
+  void publishStats();
+  void loop();  // publishes held back changes and the snapshot when values changed and a cycle has passed
+  bool setMode(const char* name);  // "topics", "snapshot" or "both"
+  static const char* topic(Id id);
+  static uint8_t decimals(Id id);  // resolution on the bus, also what set payloads are parsed to
+  static Id find(std::string_view topic);  // relative topic to id via a compile time perfect hash, count if unknown
+
+  PublishStats stats{};
+  Mode mode;
+
+ private:
+  Battery& battery;
+  Hal& hal;
+  PublishFilter filters[count];
+  uint8_t handles[count]{};
+  int32_t latest[count]{};  // scaled by the decimals of the entry
+  bool have[count]{};
+  bool dirty = false;
+  uint32_t snapshot_seq = 0;
+  unsigned long last_snapshot_time = 0;
+  bool accept(Id id, double value);
+  void send(Id id);  // latest[id] to its topic
+  void publishSnapshot();
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "hal.h"
+#include "main_vars.h"
+
+struct UnknownFrame {
+  std::atomic<uint32_t> count;  // 0 = free slot, set last so the mqtt side never sees a half filled one
+  uint32_t key;                 // canDispatchKey
+  unsigned long first_ms;
+  unsigned long last_ms;
+  unsigned long last_us;
+  uint32_t period_us;  // moving average of the gaps
+  uint8_t len;
+  uint8_t flags;  // bit 0 extended, bit 1 remote request
+  uint8_t data[8];
+};
+
+class Battery;
+
+// frames no handler claimed, one fixed open addressing slot per id: the can side pays a hash and a probe per frame
+// and never allocates, the mqtt side reads the table without locking (a payload may mix two frames of one id) for a
+// periodic digest of the busiest ids on the unknown topic and, after unknown/dump/set, every id on unknown/frames
+class UnknownFrames {
+  static_assert((can_unknown_slots & (can_unknown_slots - 1)) == 0, "slot count must be a power of two");
+
+ public:
+  explicit UnknownFrames(Battery& battery);
+
+  void record(const CanFrame& frame);  // can side
+  void loop();                         // mqtt side, digest when due and the pending dump lines
+  void dump();                         // mqtt side, every tracked id, a few lines per loop()
+
+  uint32_t ids() const { return used.load(std::memory_order_acquire); }
+
+  uint32_t overflow = 0;  // can side, frames of ids that found no slot
+
+ private:
+  Battery& battery;
+  Hal& hal;
+  UnknownFrame slots[can_unknown_slots]{};
+  std::atomic<uint32_t> used{0};
+  // mqtt side
+  uint32_t digested[can_unknown_slots]{};  // count at the last digest
+  uint32_t digested_ids = 0;
+  unsigned long last_digest_ms = 0;
+  uint32_t dump_next = can_unknown_slots;
+  void digest();
+  void dumpLine(const UnknownFrame& slot);
+};
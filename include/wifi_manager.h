@@ -2,11 +2,22 @@
 
 #include <IPAddress.h>
 
+class Battery;
+
+// non-blocking network bring up: begin() only starts the connection, loop() notices when it is there and starts
+// sntp and the mqtt session, the can side runs from the first millisecond regardless
 class WifiManager {
  public:
-  static void connect();
-  static void syncTime();
+  static void begin();
+  static void loop(Battery& battery);
 
  private:
+  static bool connected;
+  static bool time_synced;
+  static bool sntp_timeout_logged;
+  static unsigned long attempt_start;
+  static unsigned long connected_time;
+  static void onConnected(Battery& battery);
+  static void onTimeSynced(Battery& battery);
   static IPAddress getDnsServer(int index);
 };
@@ -0,0 +1,32 @@
+#include "battery.h"
+
+Battery::Battery(Hal& hal, const char* module_topic)
+    : hal(hal),
+      mqtt(*this, module_topic),
+      telemetry(*this),
+      trace(*this),
+      unknown(*this),
+      events(*this),
+      monitor(*this),
+      bus(*this),
+      can(*this),
+      store(*this),
+      ota(*this),
+      metrics(*this) {}
+
+void Battery::begin() {
+  can.init();
+  mqtt.init();
+}
+
+void Battery::connect() { mqtt.connect(); }
+
+void Battery::loop() {
+  const unsigned long start_us = metrics.loopStart();
+  mqtt.loop();
+  store.loop();
+  ota.loop();
+  can.loop();
+  metrics.loopDone(start_us);
+  metrics.loop();
+}
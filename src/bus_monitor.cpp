@@ -0,0 +1,190 @@
+#include "bus_monitor.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "battery.h"
+#include "can_dispatch.h"
+#include "fixed_point.h"
+
+BusMonitor::BusMonitor(Battery& battery) : battery(battery), hal(battery.hal) {}
+
+uint16_t BusMonitor::frameBits(const CanFrame& frame) {
+  // sof up to the crc as single bits, the part that gets stuffed
+  uint8_t bits[1 + 32 + 6 + 64 + 15];
+  uint16_t n = 0;
+  const auto put = [&](const uint32_t value, const int width) {
+    for (int i = width - 1; i >= 0; i--) {
+      bits[n++] = value >> i & 1;
+    }
+  };
+  const uint8_t len = frame.len > 8 ? 8 : frame.len;
+  put(0, 1);
+  if (frame.extd) {
+    put(frame.id >> 18 & 0x7FF, 11);
+    put(3, 2);  // srr, ide
+    put(frame.id & 0x3FFFF, 18);
+    put(frame.rtr, 1);
+    put(0, 2);  // r1, r0
+  } else {
+    put(frame.id & 0x7FF, 11);
+    put(frame.rtr, 1);
+    put(0, 2);  // ide, r0
+  }
+  put(len, 4);
+  for (uint8_t i = 0; i < len && !frame.rtr; i++) {
+    put(frame.data[i], 8);
+  }
+  uint16_t crc = 0;
+  for (uint16_t i = 0; i < n; i++) {
+    const bool invert = bits[i] ^ (crc >> 14 & 1);
+    crc = (crc << 1 & 0x7FFF) ^ (invert ? 0x4599 : 0);
+  }
+  put(crc, 15);
+  // after five equal bits the sender adds an opposite one, which starts the next run
+  uint16_t stuffed = 0;
+  uint8_t level = bits[0], run = 1;
+  for (uint16_t i = 1; i < n; i++) {
+    run = bits[i] == level ? run + 1 : 1;
+    level = bits[i];
+    if (run == 5) {
+      stuffed++;
+      level ^= 1;
+      run = 1;
+    }
+  }
+  return n + stuffed + 3 + 7 + 3;  // crc delimiter, ack slot and delimiter, eof, intermission
+}
+
+void BusMonitor::frame(const Direction direction, const CanFrame& frame) {
+  current.frames[direction]++;
+  current.bits += frameBits(frame);
+  const uint32_t key = canDispatchKey(frame);
+  for (uint8_t i = 0; i < current.id_count; i++) {
+    if (current.ids[i].key == key) {
+      current.ids[i].frames[direction]++;
+      return;
+    }
+  }
+  if (current.id_count == bus_monitor_ids) {
+    current.other_frames++;
+    return;
+  }
+  current.ids[current.id_count++] = {key, {direction == rx ? 1U : 0U, direction == tx ? 1U : 0U}};
+}
+
+void BusMonitor::alerts(const uint32_t alerts, const CanStatus& status) {
+  current.error_passive += (alerts & CAN_ALERT_ERR_PASS) != 0;
+  const unsigned long now = hal.clock->millis();
+  if (now - interval_start_ms >= bus_monitor_interval_ms) {
+    close(status, now);
+  }
+}
+
+void BusMonitor::close(const CanStatus& status, const unsigned long now_ms) {
+  current.length_ms = now_ms - interval_start_ms;
+  current.bus_errors = status.bus_error_count - last_status.bus_error_count;
+  current.rx_missed = status.rx_missed_count - last_status.rx_missed_count;
+  current.rx_overrun = status.rx_overrun_count - last_status.rx_overrun_count;
+  const uint32_t tx_failed = battery.bus.txStats().failed_attempts;
+  current.tx_failed = tx_failed - last_tx_failed;
+  last_tx_failed = tx_failed;
+  last_status = status;
+  if (ready.load(std::memory_order_acquire)) {
+    intervals_lost++;
+  } else {
+    closed = current;
+    ready.store(true, std::memory_order_release);
+  }
+  current = {};
+  interval_start_ms = now_ms;
+}
+
+void BusMonitor::loop() {
+  if (!ready.load(std::memory_order_acquire)) {
+    return;
+  }
+  publish(closed);
+  ready.store(false, std::memory_order_release);
+}
+
+// frames per 10 s, i.e. frames/s with one decimal
+static int32_t rate(const uint32_t frames, const unsigned long length_ms) {
+  return length_ms ? static_cast<int32_t>(static_cast<uint64_t>(frames) * 10000U / length_ms) : 0;
+}
+
+void BusMonitor::publish(const Interval& interval) {
+  intervals++;
+  const unsigned long length_ms = interval.length_ms ? interval.length_ms : 1;
+  load_hundredths = static_cast<uint16_t>(static_cast<uint64_t>(interval.bits) * 10000000U / can_bitrate / length_ms);
+  const int32_t rx_rate = rate(interval.frames[rx], length_ms);
+  uint8_t raised = 0;
+  if (static_cast<uint64_t>(interval.bus_errors + interval.rx_missed + interval.rx_overrun) * 1000U >=
+      static_cast<uint64_t>(bus_alarm_errors_per_s) * length_ms) {
+    raised |= alarm_errors;
+  }
+  if (load_hundredths >= bus_alarm_load_percent * 100U) {
+    raised |= alarm_load;
+  }
+  if (rx_rate * 100 < static_cast<int64_t>(last_rx_rate) * (100 - bus_alarm_rx_drop_percent)) {
+    raised |= alarm_rx_drop;
+  }
+  last_rx_rate = rx_rate;
+  char names[32];
+  snprintf(names, sizeof(names), "%s%s%s", raised & alarm_errors ? "errors," : "", raised & alarm_load ? "load," : "",
+           raised & alarm_rx_drop ? "rx_drop," : "");
+  names[raised ? strlen(names) - 1 : 0] = '\0';
+  if (raised != alarms) {
+    char line[64];
+    snprintf(line, sizeof(line), raised ? "bus alarm: %s" : "bus alarms cleared", names);
+    hal.log->println(line);
+    battery.mqtt.log(line);
+    alarms_raised += __builtin_popcount(raised & ~alarms);
+    alarms = raised;
+  }
+
+  if (!hal.mqtt->connected()) {
+    return;
+  }
+  char json[768];
+  char load[12], rx_text[12], tx_text[12];
+  formatFixed(load_hundredths, 2, load, sizeof(load));
+  formatFixed(rx_rate, 1, rx_text, sizeof(rx_text));
+  formatFixed(rate(interval.frames[tx], length_ms), 1, tx_text, sizeof(tx_text));
+  int pos = snprintf(json, sizeof(json),
+                     "{\"interval_ms\":%lu,\"load_percent\":%s,\"rx_per_s\":%s,\"tx_per_s\":%s,\"tx_failed\":%lu,"
+                     "\"error_passive\":%lu,\"bus_errors\":%lu,\"rx_missed\":%lu,\"rx_overrun\":%lu,"
+                     "\"alarms\":\"%s\",\"ids\":{",
+                     interval.length_ms, load, rx_text, tx_text, static_cast<unsigned long>(interval.tx_failed),
+                     static_cast<unsigned long>(interval.error_passive),
+                     static_cast<unsigned long>(interval.bus_errors), static_cast<unsigned long>(interval.rx_missed),
+                     static_cast<unsigned long>(interval.rx_overrun), names);
+  // per id: [rx/s, tx/s], the trailer always keeps its room, ids past that are counted with the other frames
+  constexpr size_t trailer_size = sizeof("},\"other_frames\":4294967295}");
+  if (pos < 0 || static_cast<size_t>(pos) + trailer_size > sizeof(json)) {
+    return;  // never with the fixed header, but no partial json goes out
+  }
+  uint32_t other_frames = interval.other_frames;
+  bool first = true;
+  for (uint8_t i = 0; i < interval.id_count; i++) {
+    const IdCount& id = interval.ids[i];
+    formatFixed(rate(id.frames[rx], length_ms), 1, rx_text, sizeof(rx_text));
+    formatFixed(rate(id.frames[tx], length_ms), 1, tx_text, sizeof(tx_text));
+    const bool extended = id.key & can_dispatch_extended;
+    char entry[48];
+    const int length = snprintf(entry, sizeof(entry), extended ? "%s\"%08lx\":[%s,%s]" : "%s\"%03lx\":[%s,%s]",
+                                first ? "" : ",", static_cast<unsigned long>(id.key & ~can_dispatch_extended),
+                                rx_text, tx_text);
+    if (length > 0 && static_cast<size_t>(length) < sizeof(entry) &&
+        static_cast<size_t>(pos + length) + trailer_size <= sizeof(json)) {
+      memcpy(json + pos, entry, length);
+      pos += length;
+      first = false;
+    } else {
+      other_frames += id.frames[rx] + id.frames[tx];
+    }
+  }
+  snprintf(json + pos, sizeof(json) - pos, "},\"other_frames\":%lu}", static_cast<unsigned long>(other_frames));
+  // too long for the queue slots, goes out directly
+  battery.mqtt.publish("bus", json, false, false);
+}
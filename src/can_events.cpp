@@ -0,0 +1,67 @@
+#include "can_events.h"
+
+#include <cstdio>
+
+#include "battery.h"
+
+void CanEvents::post(const CanEvent& event) {
+  if (!events.push(event)) {
+    dropped++;
+  }
+}
+
+void CanEvents::publish(const Telemetry::Id id, const float value) {
+  CanEvent event{};
+  event.kind = CanEvent::value_float;
+  event.id = id;
+  event.f = value;
+  post(event);
+}
+
+void CanEvents::publish(const Telemetry::Id id, const uint32_t value) {
+  CanEvent event{};
+  event.kind = CanEvent::value_uint;
+  event.id = id;
+  event.u = value;
+  post(event);
+}
+
+void CanEvents::inverterType(const CanFrame& frame) {
+  CanEvent event{};
+  event.kind = CanEvent::inverter_type;
+  event.frame = frame;
+  post(event);
+}
+
+void CanEvents::log(const char* text) {
+  CanEvent event{};
+  event.kind = CanEvent::log;
+  event.text = text;
+  post(event);
+}
+
+void CanEvents::dispatch() {
+  CanEvent event;
+  while (events.pop(event)) {
+    switch (event.kind) {
+      case CanEvent::value_float:
+        battery.telemetry.publish(event.id, event.f);
+        break;
+      case CanEvent::value_uint:
+        battery.telemetry.publish(event.id, event.u);
+        break;
+      case CanEvent::inverter_type: {
+        char inverter_name[8] = {};
+        for (uint8_t i = 1; i < event.frame.len && i < 8; i++) {
+          inverter_name[i - 1] = static_cast<char>(event.frame.data[i]);
+        }
+        if (inverter_name[0] != '\0') {
+          battery.mqtt.publish("inverter/type", inverter_name, true);
+        }
+      } break;
+      case CanEvent::log:
+        battery.mqtt.log(event.text);
+        break;
+    }
+  }
+}
@@ -1,58 +1,19 @@
 #include "can_manager.h"
 
+#include <cstdio>
 #include <cstring>
 
+#include "battery.h"
+#include "byd_frames.h"
 #include "config.h"
-#include "esp32_can.h"
+#include "hal.h"
 #include "main_vars.h"
-#include "mqtt_manager.h"
 
 float CanManager::number_of_cells = static_cast<float>(battery_modules * battery_cells_per_module);
 
-float CanManager::limit_battery_voltage_max;
-float CanManager::limit_battery_voltage_min;
-float CanManager::limit_discharge_current_max;
-float CanManager::limit_charge_current_max;
-
-float CanManager::battery_voltage;
-float CanManager::battery_current;
-float CanManager::battery_temp;
-
-float CanManager::cell_temp_max;
-float CanManager::cell_temp_min;
-
-float CanManager::soc_percent;
-float CanManager::soh_percent;
-float CanManager::remaining_capacity_ah;
-float CanManager::full_capacity_ah;
-
-unsigned long CanManager::last_successful_send = 0;
-
-unsigned long CanManager::last_send_2s;
-unsigned long CanManager::last_send_10s;
-unsigned long CanManager::last_send_60s;
-
-bool CanManager::init_failed = false;
-
-std::map<String, ValueConfig> CanManager::value_map = {
-    {"limits/max_voltage", {&limit_battery_voltage_max, max_cell_voltage* number_of_cells}},
-    {"limits/min_voltage", {&limit_battery_voltage_min, min_cell_voltage* number_of_cells}},
-    {"limits/max_discharge_current", {&limit_discharge_current_max, max_current}},
-    {"limits/max_charge_current", {&limit_charge_current_max, max_current}},
-    {"battery/voltage", {&battery_voltage, default_cell_voltage* number_of_cells}},
-    {"battery/current", {&battery_current, 0.f}},
-    {"battery/temp", {&battery_temp, 12.f}},
-    {"battery/max_cell_temp", {&cell_temp_max, 13.f}},
-    {"battery/min_cell_temp", {&cell_temp_min, 11.f}},
-    {"battery/soc", {&soc_percent, 50.f}},
-    {"battery/soh", {&soh_percent, 100.f}},
-    {"battery/remaining_capacity_ah", {&remaining_capacity_ah, 80.f}},
-    {"battery/full_capacity_ah", {&full_capacity_ah, 160.f}},
-};
-
 struct Message {
   unsigned long id;
-  byte data[8];
+  uint8_t data[8];
 };
 
 const Message initMessages[] = {
@@ -67,204 +28,285 @@ const Message initMessages[] = {
     {0x3D0, {0x03, 'V', 'S', 0x00, 0x00, 0x00, 0x00, 0x00}},
 };
 
-template <typename T>
-void setBytes(uint8_t* data, const size_t start, T value) {
-  const auto value_bytes = reinterpret_cast<uint8_t*>(&value);
-  for (size_t i = 0; i < sizeof(T); i++) {
-    data[start + i] = value_bytes[sizeof(T) - i - 1];  // big-endian
-  }
-}
-
-template <typename T>
-T getValue(const uint8_t* data, const size_t start) {
-  T value{};
-  const auto value_bytes = reinterpret_cast<uint8_t*>(&value);
-  for (size_t i = 0; i < sizeof(T); ++i) {
-    value_bytes[sizeof(T) - 1 - i] = data[start + i];  // big-endian
-  }
-  return value;
-}
+// indexed by Telemetry::Id, the inverter values are left out and stay read only
+CanManager::CanManager(Battery& battery)
+    : settings{
+          {&limit_battery_voltage_max, max_cell_voltage * number_of_cells},
+          {&limit_battery_voltage_min, min_cell_voltage * number_of_cells},
+          {&limit_discharge_current_max, max_current},
+          {&limit_charge_current_max, max_current},
+          {&battery_voltage, default_cell_voltage * number_of_cells},
+          {&battery_current, 0.f},
+          {&battery_temp, 12.f},
+          {&cell_temp_max, 13.f},
+          {&cell_temp_min, 11.f},
+          {&soc_percent, 50.f},
+          {&soh_percent, 100.f},
+          {&remaining_capacity_ah, 80.f},
+          {&full_capacity_ah, 160.f},
+      },
+      battery(battery),
+      hal(battery.hal) {}
 
 void CanManager::init() {
-  for (auto& [key, value] : value_map) {
-    *value.valuePtr = value.defaultValue;
+  for (const auto& setting : settings) {
+    if (setting.valuePtr) {
+      *setting.valuePtr = setting.defaultValue;
+    }
+  }
+  battery.store.load();  // warm start, the first frames already carry the persisted values
+  registerHandler(InverterBatteryFrame::id, onInverterBattery);
+  registerHandler(InverterSocFrame::id, onInverterSoc);
+  registerHandler(InverterTimestampFrame::id, onInverterTimestamp);
+  registerHandler(0x151, onInverterInfoRequest);
+  const CanFilter filter = can_hw_filter ? dispatcher.filter() : CanFilter{0, 0xFFFFFFFF, true};
+  hal.log->printf("CAN filter: code %08lx mask %08lx %s\n", static_cast<unsigned long>(filter.acceptance_code),
+                  static_cast<unsigned long>(filter.acceptance_mask), filter.single_filter ? "single" : "dual");
+  init_failed = !battery.bus.init(filter);
+  if (!init_failed) {
+    battery.boot.mark(BootTimeline::can_started, hal.clock->micros());
+  }
+  scheduler.add(
+      LimitsFrame::id,
+      [](void* can, const bool triggered, const unsigned long trigger_us) {
+        static_cast<CanManager*>(can)->sendLimits(triggered, trigger_us);
+      },
+      this, 2UL * 1000UL);
+  scheduler.add(CellInfoFrame::id, scheduled<&CanManager::sendCellInfo>, this, 10UL * 1000UL);
+  scheduler.add(BatteryInfoFrame::id, scheduled<&CanManager::sendBatteryInfo>, this, 10UL * 1000UL);
+  scheduler.add(StatesFrame::id, scheduled<&CanManager::sendStates>, this, 10UL * 1000UL);
+  scheduler.add(0x190, scheduled<&CanManager::sendAlarm>, this, 60UL * 1000UL);
+  scheduler.start(hal.clock->micros());
+  if (!init_failed) {
+    task_running = hal.board->startTask(task, "can", can_task_stack_size, can_task_priority, this);
   }
-  init_failed = !ESP32Can::init();
-  const unsigned long now = millis();
-  last_send_2s = now;
-  last_send_10s = now + 333UL;
-  last_send_60s = now + 667UL;
 }
 
-bool CanManager::send(uint32_t id, uint8_t len, uint8_t* buf) {
-  digitalWrite(LED_BUILTIN, LED_ON);
-  bool send_successful = ESP32Can::send(id, len, buf);
-  digitalWrite(LED_BUILTIN, LED_OFF);
+bool CanManager::send(uint32_t id, uint8_t len, uint8_t* buf, const bool periodic, const bool urgent,
+                      const unsigned long origin_us) {
+  hal.board->setLed(true);
+  bool send_successful = battery.bus.send(id, len, buf, periodic, urgent, origin_us);
+  hal.board->setLed(false);
   if (send_successful) {
-    last_successful_send = millis();
+    last_successful_send = hal.clock->millis();
   }
   return send_successful;
 }
 
 void CanManager::loop() {
   if (init_failed) {
-    if (millis() >= 5UL * 60UL * 1000UL) {
-      MqttManager::log("can init failed - restarting!", false);
-      ESP.restart();
+    if (hal.clock->millis() >= 5UL * 60UL * 1000UL) {
+      battery.mqtt.log("can init failed - restarting!", false);
+      battery.store.flush();
+      hal.board->restart();
     }
     return;
   }
-  ESP32Can::loop();
-  if (millis() - last_send_2s >= 2UL * 1000UL) {
-    last_send_2s = millis();
-    sendLimits();
+  if (!task_running) {
+    service(0);
   }
-  if (millis() - last_send_10s >= 10UL * 1000UL) {
-    last_send_10s = millis();
-    sendCellInfo();
-    sendBatteryInfo();
-    sendStates();
+  battery.events.dispatch();
+  battery.telemetry.loop();
+  battery.trace.poll();
+  battery.unknown.loop();
+  battery.monitor.loop();
+  if (hal.clock->millis() - last_stats_time >= stats_interval_ms) {
+    last_stats_time = hal.clock->millis();
+    publishStats();
   }
-  if (millis() - last_send_60s >= 60UL * 1000UL) {
-    last_send_60s = millis();
-    sendAlarm();
+}
+
+void CanManager::publishStats() {
+  battery.telemetry.publishStats();
+  const CanTxStats& tx = battery.bus.txStats();  // written by the can task, single words are good enough here
+  battery.mqtt.publish("stats/can_tx_sent", tx.sent);
+  battery.mqtt.publish("stats/can_tx_failed_attempts", tx.failed_attempts);
+  battery.mqtt.publish("stats/can_tx_dropped", tx.dropped_stale + tx.dropped_full);
+  battery.mqtt.publish("stats/can_tx_dropped_attempts", tx.dropped_attempts);
+  battery.mqtt.publish("stats/can_tx_superseded", tx.superseded);
+  battery.mqtt.publish("stats/can_tx_latency_avg_us", tx.avg_latency_us);
+  battery.mqtt.publish("stats/can_tx_latency_max_us", tx.max_latency_us);
+  battery.mqtt.publish("stats/can_tx_urgent_sent", tx.urgent_sent);
+  battery.mqtt.publish("stats/can_tx_urgent_latency_avg_us", tx.urgent_latency_avg_us);
+  battery.mqtt.publish("stats/can_tx_urgent_latency_max_us", tx.urgent_latency_max_us);
+  battery.mqtt.publish("stats/settings_flushes", battery.store.stats.flushes);
+  battery.mqtt.publish("stats/settings_flush_failed", battery.store.stats.failed);
+  battery.mqtt.publish("stats/settings_coalesced", battery.store.stats.coalesced);
+  for (size_t i = 0; i < scheduler.size(); i++) {
+    const FrameScheduler::Task& task = scheduler[i];
+    char topic[48];
+    snprintf(topic, sizeof(topic), "stats/schedule/%03lx/jitter_avg_us", static_cast<unsigned long>(task.id));
+    battery.mqtt.publish(topic, task.stats.jitter_avg_us);
+    snprintf(topic, sizeof(topic), "stats/schedule/%03lx/jitter_max_us", static_cast<unsigned long>(task.id));
+    battery.mqtt.publish(topic, task.stats.jitter_max_us);
+    snprintf(topic, sizeof(topic), "stats/schedule/%03lx/skipped", static_cast<unsigned long>(task.id));
+    battery.mqtt.publish(topic, task.stats.skipped);
+    snprintf(topic, sizeof(topic), "stats/schedule/%03lx/triggered", static_cast<unsigned long>(task.id));
+    battery.mqtt.publish(topic, task.stats.triggered);
   }
 }
 
-void CanManager::sendLimits() {
-  float limit_discharge = limit_discharge_current_max;
-  float limit_charge = limit_charge_current_max;
-  if (millis() - MqttManager::last_master_heartbeat_time >= heartbeat_timeout_limits_ms) {
-    limit_discharge = 0;
-    limit_charge = 0;
-    MqttManager::log("Master Heartbeat missed!");
+// can task: sleeps on the TWAI alerts until a frame arrives or the next periodic frame is due, so inverter frames
+// are handled right away no matter what the network side is doing
+void CanManager::task(void* arg) {
+  CanManager& can = *static_cast<CanManager*>(arg);
+  for (;;) {
+    can.service(can.untilNextSend());
   }
-  byte data[8]{};
-  setBytes(data, 0, static_cast<uint16_t>(limit_battery_voltage_max * 10.f));  // 230V max
-  setBytes(data, 2, static_cast<uint16_t>(limit_battery_voltage_min * 10.f));  // 170V min
-  setBytes(data, 4, static_cast<uint16_t>(limit_discharge * 10.f));            // 25,6A max discharge
-  setBytes(data, 6, static_cast<uint16_t>(limit_charge * 10.f));               // 25,6A max charge
-  if (send(0x110, 8, data)) {
-    MqttManager::publish("limits/max_voltage", limit_battery_voltage_max);
-    MqttManager::publish("limits/min_voltage", limit_battery_voltage_min);
-    MqttManager::publish("limits/max_discharge_current", limit_discharge);
-    MqttManager::publish("limits/max_charge_current", limit_charge);
+}
+
+unsigned long CanManager::untilNextSend() {
+  unsigned long wait = battery.bus.untilNextTxMs();
+  if (wait > can_task_max_wait_ms) {
+    wait = can_task_max_wait_ms;
+  }
+  // rounded up, waking a tick late beats spinning on a not yet due slot
+  const unsigned long schedule_wait_us = scheduler.untilNextUs(hal.clock->micros());
+  if (schedule_wait_us < static_cast<unsigned long>(wait) * 1000UL) {
+    wait = (schedule_wait_us + 999UL) / 1000UL;
+  }
+  return wait;
+}
+
+// everything touching the bus, runs in the can task (or inline from loop()), talks to mqtt only via CanEvents
+void CanManager::service(const unsigned long alert_timeout_ms) {
+  // soc_percent is only written here, so a correction cannot land between the model's read and write
+  if (const float soc = soc_set.exchange(NAN, std::memory_order_relaxed); !std::isnan(soc)) {
+    soc_percent = soc;
+  }
+  battery.bus.loop(alert_timeout_ms);
+  // heartbeat loss zeroes the limits right away instead of on the next 0x110 slot, and so does its return
+  if (heartbeatLost() != heartbeat_lost) {
+    heartbeat_lost = !heartbeat_lost;
+    scheduler.trigger(LimitsFrame::id, hal.clock->micros());
+  }
+  scheduler.run(hal.clock->micros());
+}
+
+bool CanManager::heartbeatLost() const {
+  return hal.clock->millis() - battery.mqtt.last_master_heartbeat_time >= heartbeat_timeout_limits_ms;
+}
+
+void CanManager::triggerLimits() { scheduler.trigger(LimitsFrame::id, hal.clock->micros()); }
+
+void CanManager::setSoc(const float percent) { soc_set.store(percent, std::memory_order_relaxed); }
+
+bool CanManager::configureSchedule(const uint32_t id, const unsigned long period_ms, const unsigned long phase_ms) {
+  return scheduler.configure(id, period_ms, phase_ms);
+}
+
+bool CanManager::resetSchedule(const uint32_t id) { return scheduler.reset(id); }
+
+void CanManager::sendLimits(const bool triggered, const unsigned long trigger_us) {
+  effective_discharge_current_max = limit_discharge_current_max;
+  effective_charge_current_max = limit_charge_current_max;
+  heartbeat_lost = heartbeatLost();
+  if (heartbeat_lost) {
+    effective_discharge_current_max = 0;
+    effective_charge_current_max = 0;
+    battery.events.log("Master Heartbeat missed!");
+  }
+  uint8_t data[8]{};
+  LimitsFrame::encode(*this, data);
+  if (send(LimitsFrame::id, 8, data, true, triggered, trigger_us)) {
+    battery.events.publish(Telemetry::limits_max_voltage, limit_battery_voltage_max);
+    battery.events.publish(Telemetry::limits_min_voltage, limit_battery_voltage_min);
+    battery.events.publish(Telemetry::limits_max_discharge_current, effective_discharge_current_max);
+    battery.events.publish(Telemetry::limits_max_charge_current, effective_charge_current_max);
   }
 }
 
 void CanManager::sendBatteryInfo() {
-  byte data[8]{};
-  setBytes(data, 0, static_cast<int16_t>(battery_voltage * 10.f));  // 215V battery voltage
-  setBytes(data, 2, static_cast<int16_t>(battery_current * 10.f));  // 4,3A battery current
-  setBytes(data, 4, static_cast<int16_t>(battery_temp * 10.f));     // 22°C battery temp
-  setBytes(data, 6, static_cast<int16_t>(776));                     // some sort of status bytes?
-  if (send(0x1d0, 8, data)) {
-    MqttManager::publish("battery/voltage", battery_voltage);
-    MqttManager::publish("battery/current", battery_current);
-    MqttManager::publish("battery/temp", battery_temp);
+  uint8_t data[8]{};
+  BatteryInfoFrame::encode(*this, data);
+  if (send(BatteryInfoFrame::id, 8, data, true)) {
+    battery.events.publish(Telemetry::battery_voltage, battery_voltage);
+    battery.events.publish(Telemetry::battery_current, battery_current);
+    battery.events.publish(Telemetry::battery_temp, battery_temp);
   }
 }
 
 void CanManager::sendCellInfo() {
-  byte data[8]{};
-  setBytes(data, 0, static_cast<uint16_t>(cell_temp_max * 10.f));  // 23°C max cell temp
-  setBytes(data, 2, static_cast<uint16_t>(cell_temp_min * 10.f));  // 22°C min cell temp
-  if (send(0x210, 8, data)) { // sungrow not checking data?
-    MqttManager::publish("battery/max_cell_temp", cell_temp_max);
-    MqttManager::publish("battery/min_cell_temp", cell_temp_min);
+  uint8_t data[8]{};
+  CellInfoFrame::encode(*this, data);
+  if (send(CellInfoFrame::id, 8, data, true)) { // sungrow not checking data?
+    battery.events.publish(Telemetry::battery_max_cell_temp, cell_temp_max);
+    battery.events.publish(Telemetry::battery_min_cell_temp, cell_temp_min);
   }
 }
 
 void CanManager::sendStates() {
   remaining_capacity_ah = soc_percent / 100 * full_capacity_ah;  // calculate remaining_capacity_ah by soc
-  byte data[8]{};
-  setBytes(data, 0, static_cast<uint16_t>(soc_percent * 100.f));           // 28,7% soc % Vrfd
-  setBytes(data, 2, static_cast<uint16_t>(soh_percent * 100.f));           // 100% soh % Vrfd
-  setBytes(data, 4, static_cast<uint16_t>(remaining_capacity_ah * 10.f));  // remaining capacity 1/10Ah (ignored by sungrow?)
-  setBytes(data, 6, static_cast<uint16_t>(full_capacity_ah * 10.f));       // fully charged capacity 1/10Ah (ignored by sungrow?)
-  if (send(0x150, 8, data)) {
-    MqttManager::publish("battery/soc", soc_percent);
-    MqttManager::publish("battery/soh", soh_percent);
-    MqttManager::publish("battery/remaining_capacity_ah", remaining_capacity_ah);
-    MqttManager::publish("battery/full_capacity_ah", full_capacity_ah);
+  uint8_t data[8]{};
+  StatesFrame::encode(*this, data);
+  if (send(StatesFrame::id, 8, data, true)) {
+    battery.events.publish(Telemetry::battery_soc, soc_percent);
+    battery.events.publish(Telemetry::battery_soh, soh_percent);
+    battery.events.publish(Telemetry::battery_remaining_capacity_ah, remaining_capacity_ah);
+    battery.events.publish(Telemetry::battery_full_capacity_ah, full_capacity_ah);
   }
 }
 
 void CanManager::sendAlarm() {
-  byte data[8]{};
-  send(0x190, 8, data);
+  uint8_t data[8]{};
+  send(0x190, 8, data, true);
 }
 
-String twaiToString(const twai_message_t &m) {
-  const bool ext = (m.flags & TWAI_MSG_FLAG_EXTD);
-  const uint8_t dlc = (m.data_length_code > 8) ? 8 : m.data_length_code;
-
-  char idbuf[9]; // 8 Hex + NUL
-  snprintf(idbuf, sizeof(idbuf), ext ? "%08X" : "%03X", static_cast<unsigned int>(m.identifier));
-
-  String s;
-  s.reserve(9 + 1 + dlc * 2);
-  s += idbuf;
-  s += '#';
-
-  // RTR -> no data -> only "ID#"
-  if (!(m.flags & TWAI_MSG_FLAG_RTR)) {
-    for (uint8_t i = 0; i < dlc; i++) {
-      char b[3];
-      snprintf(b, sizeof(b), "%02X", m.data[i]);
-      s += b;
-    }
+bool CanManager::registerHandler(const uint32_t id, const Handler handler) {
+  if (!dispatcher.add(id, handler)) {
+    hal.log->printf("can dispatch table full, dropping handler for %03lx\n", static_cast<unsigned long>(id));
+    return false;
   }
-  return s;
+  return true;
 }
 
-void CanManager::readMessage(const twai_message_t& message) {
-  const uint32_t rxId = message.identifier;
-  const uint8_t len = message.data_length_code;
-  uint8_t rxBuf[9] = {};
-  std::memcpy(rxBuf, message.data, len);
-
-  Serial.print("recv: ");
-  if (message.extd) {
-    Serial.printf("Extended ID: 0x%.8lX  DLC: %1d  Data:", rxId, len);
+void CanManager::readMessage(const CanFrame& message) {
+  const Handler handler = dispatcher.find(canDispatchKey(message));
+  // traced before handling so replies (init messages) come after the request in the trace
+  battery.trace.record(handler ? CanTrace::rx : CanTrace::rx_unknown, message);
+  if (handler) {
+    handler(*this, message);
   } else {
-    Serial.printf("Standard ID: 0x%.3lX       DLC: %1d  Data:", rxId, len);
+    battery.unknown.record(message);
   }
-  if (message.rtr) {
-    Serial.print(" REMOTE REQUEST FRAME");
-  } else {
-    for (byte i = 0; i < len; i++) {
-      Serial.printf(" 0x%.2X", rxBuf[i]);
+}
+
+void CanManager::onInverterBattery(CanManager& can, const CanFrame& message) {
+  InverterBatteryFrame::decode(can, message.data);
+  if (can.soc_model.enabled.load(std::memory_order_relaxed)) {
+    // the limits bound what the inverter may draw, anything beyond is a bad frame rather than real current
+    float current = soc_model_current_sign * can.inverter_battery_current;
+    if (current > can.limit_charge_current_max) {
+      current = can.limit_charge_current_max;
+    } else if (current < -can.limit_discharge_current_max) {
+      current = -can.limit_discharge_current_max;
     }
-    Serial.println();
+    can.soc_percent = can.soc_model.update(can.soc_percent, current, can.full_capacity_ah, can.hal.clock->micros());
+  } else {
+    can.soc_model.stop();
   }
+  can.battery.events.publish(Telemetry::inverter_battery_voltage, can.inverter_battery_voltage);
+  can.battery.events.publish(Telemetry::inverter_battery_current, can.inverter_battery_current);
+  can.battery.events.publish(Telemetry::inverter_temperature, can.inverter_temperature);
+}
 
-  if (rxId == 0x91) {
-    const auto wr_battery_voltage = getValue<uint16_t>(rxBuf, 0);
-    const auto wr_battery_current = getValue<uint16_t>(rxBuf, 2); // int16_t ?
-    const auto wr_temperature = getValue<uint16_t>(rxBuf, 4);
-    MqttManager::publish("inverter/battery_voltage", static_cast<float>(wr_battery_voltage) * 0.1f);
-    MqttManager::publish("inverter/battery_current", static_cast<float>(wr_battery_current) * 0.1f);
-    MqttManager::publish("inverter/temperature", static_cast<float>(wr_temperature) * 0.1f);
-  } else if (rxId == 0xd1) {
-    const auto wr_soc = getValue<uint16_t>(rxBuf, 0);
-    MqttManager::publish("inverter/soc", static_cast<float>(wr_soc) * 0.1f);
-  } else if (rxId == 0x111) {
-    const auto wr_timestamp = getValue<uint32_t>(rxBuf, 0);
-    MqttManager::publish("inverter/timestamp", wr_timestamp);
-  } else if (rxId == 0x151 && rxBuf[0] == 0x0) {
-    rxBuf[len] = '\0';
-    if (const auto inverter_name = String(reinterpret_cast<char*>(rxBuf + 1)); inverter_name.length() > 0) {
-      MqttManager::publish("inverter/type", String(reinterpret_cast<char*>(rxBuf + 1)), true);
-    }
-  } else if (rxId == 0x151 && rxBuf[0] == 0x1) {
-    MqttManager::log("sending initMessages!");
+void CanManager::onInverterSoc(CanManager& can, const CanFrame& message) {
+  InverterSocFrame::decode(can, message.data);
+  can.battery.events.publish(Telemetry::inverter_soc, can.inverter_soc);
+}
+
+void CanManager::onInverterTimestamp(CanManager& can, const CanFrame& message) {
+  InverterTimestampFrame::decode(can, message.data);
+  can.battery.events.publish(Telemetry::inverter_timestamp, can.inverter_timestamp);
+}
+
+void CanManager::onInverterInfoRequest(CanManager& can, const CanFrame& message) {
+  if (message.data[0] == 0x0) {
+    can.battery.events.inverterType(message);
+  } else if (message.data[0] == 0x1) {
+    can.battery.events.log("sending initMessages!");
     for (const auto& [id, data] : initMessages) {
-      for (int attempts = 0; attempts < 3 && !send(id, 8, const_cast<byte*>(data)); attempts++) {
-        delayMicroseconds(10);
-      }
+      can.send(id, 8, const_cast<uint8_t*>(data));  // retried by the tx queue
     }
-  } else {
-    MqttManager::log(twaiToString(message));
   }
 }
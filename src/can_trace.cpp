@@ -0,0 +1,159 @@
+#include "can_trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "battery.h"
+#include "fixed_point.h"
+
+void formatFrame(const CanFrame& frame, char* buf, const size_t size) {
+  const uint8_t dlc = (frame.len > 8) ? 8 : frame.len;
+  int pos = snprintf(buf, size, frame.extd ? "%08lX#" : "%03lX#", static_cast<unsigned long>(frame.id));
+
+  // RTR -> no data -> only "ID#R"
+  if (frame.rtr) {
+    snprintf(buf + pos, size - pos, "R");
+    return;
+  }
+  for (uint8_t i = 0; i < dlc && pos > 0 && static_cast<size_t>(pos) < size; i++) {
+    pos += snprintf(buf + pos, size - pos, "%02X", frame.data[i]);
+  }
+}
+
+bool parseFrame(const char* text, CanFrame& frame) {
+  const char* hash = strchr(text, '#');
+  if (hash == nullptr || hash == text) {
+    return false;
+  }
+  frame = CanFrame{};
+  frame.extd = hash - text > 3;
+  for (const char* c = text; c < hash; c++) {
+    const int digit = hexDigit(*c);
+    if (digit < 0 || hash - text > 8) {
+      return false;
+    }
+    frame.id = frame.id << 4 | digit;
+  }
+  const char* data = hash + 1;
+  if (*data == 'R' || *data == 'r') {
+    frame.rtr = true;
+    data++;
+  }
+  while (!frame.rtr && frame.len < 8) {
+    if (*data == '.') {
+      data++;  // candump allows dots between bytes
+    }
+    const int high = hexDigit(data[0]);
+    const int low = high < 0 ? -1 : hexDigit(data[1]);
+    if (low < 0) {
+      break;
+    }
+    frame.data[frame.len++] = high << 4 | low;
+    data += 2;
+  }
+  // only a line end may follow, anything else ("123#GG", an odd nibble, a ninth byte) is malformed
+  while (*data == ' ' || *data == '\t' || *data == '\r' || *data == '\n') {
+    data++;
+  }
+  return *data == '\0';
+}
+
+static CanFrame toFrame(const TraceRecord& record) {
+  CanFrame frame{};
+  frame.id = record.id;
+  frame.len = record.len;
+  frame.extd = record.flags & 0x1;
+  frame.rtr = record.flags & 0x2;
+  std::memcpy(frame.data, record.data, sizeof(frame.data));
+  return frame;
+}
+
+CanTrace::CanTrace(Battery& battery) : battery(battery), hal(battery.hal) {}
+
+void CanTrace::push(const Kind kind, const CanFrame& frame) {
+  TraceRecord record;
+  record.time_us = hal.clock->micros();
+  record.id = frame.id;
+  record.kind = kind;
+  record.len = frame.len;
+  record.flags = (frame.extd ? 0x1 : 0) | (frame.rtr ? 0x2 : 0);
+  std::memcpy(record.data, frame.data, sizeof(record.data));
+  if (!records.push(record)) {
+    dropped++;
+  }
+}
+
+void CanTrace::format(const TraceRecord& record, char* buf, const size_t size) {
+  int pos = snprintf(buf, size, "%lu.%06lu %s: %s ID: 0x%.*lX  DLC: %1d  Data:",
+                     static_cast<unsigned long>(record.time_us / 1000000UL),
+                     static_cast<unsigned long>(record.time_us % 1000000UL), record.kind == tx ? "send" : "recv",
+                     record.flags & 0x1 ? "Extended" : "Standard", record.flags & 0x1 ? 8 : 3,
+                     static_cast<unsigned long>(record.id), record.len);
+  if (record.flags & 0x2) {
+    snprintf(buf + pos, size - pos, " REMOTE REQUEST FRAME");
+    return;
+  }
+  for (uint8_t i = 0; i < record.len && i < 8 && pos > 0 && static_cast<size_t>(pos) < size; i++) {
+    pos += snprintf(buf + pos, size - pos, " 0x%.2X", record.data[i]);
+  }
+}
+
+// longest queued lines: a 32 bit micros() stamp or 136 years of candump time, an extended id and 8 data bytes
+static constexpr size_t trace_line_size = sizeof("4294.967295 recv: Extended ID: 0x1FFFFFFF  DLC: 8  Data:") + 8 * 5;
+static constexpr size_t candump_line_size = sizeof("(4294967295.999999) rx 1FFFFFFF#0011223344556677");
+static_assert(trace_line_size <= max_mqtt_payload_length && candump_line_size <= max_mqtt_payload_length,
+              "trace lines must fit a mqtt queue slot");
+
+void CanTrace::poll() {
+  TraceRecord record;
+  for (unsigned int i = 0; i < can_trace_poll_max && records.pop(record); i++) {
+    capture[capture_total % can_capture_size] = record;
+    capture_total++;
+    if (serial_enabled) {
+      char line[128];
+      format(record, line, sizeof(line));
+      hal.log->println(line);
+    }
+  }
+  const uint8_t request = dump_request.exchange(0, std::memory_order_acq_rel);
+  if (request != 0) {
+    startDump(static_cast<DumpFormat>(request - 1));
+  }
+  for (unsigned int i = 0; i < can_capture_dump_per_poll && dump_next != dump_end; i++) {
+    dumpNext();
+  }
+}
+
+void CanTrace::startDump(const DumpFormat format) {
+  dump_format = format;
+  dump_end = capture_total;
+  dump_next = capture_total > can_capture_size ? capture_total - can_capture_size : 0;
+  dump_time_us = dump_next != dump_end ? capture[dump_next % can_capture_size].time_us : 0;
+  dump_last_us = static_cast<uint32_t>(dump_time_us);
+}
+
+void CanTrace::dumpNext() {
+  const bool skipped = capture_total - dump_next > can_capture_size;
+  if (skipped) {
+    dump_next = capture_total - can_capture_size;  // overwritten while dumping
+  }
+  const TraceRecord& record = capture[dump_next % can_capture_size];
+  if (skipped) {
+    dump_last_us = record.time_us;  // the gap is unknown, continue without one
+  }
+  dump_next++;
+  char line[128];
+  if (dump_format == text) {
+    format(record, line, sizeof(line));
+    battery.mqtt.publish("trace", line, false, true, 5);
+    return;
+  }
+  // micros() wraps after ~71 minutes, consecutive records are much closer than that
+  dump_time_us += record.time_us - dump_last_us;
+  dump_last_us = record.time_us;
+  const int pos = snprintf(line, sizeof(line), "(%lu.%06lu) %s ", static_cast<unsigned long>(dump_time_us / 1000000U),
+                           static_cast<unsigned long>(dump_time_us % 1000000U), record.kind == tx ? "tx" : "rx");
+  formatFrame(toFrame(record), line + pos, sizeof(line) - pos);
+  battery.mqtt.publish("candump", line, false, true, 5);
+}
@@ -0,0 +1,143 @@
+#include "can_tx_queue.h"
+
+#include <cstring>
+
+static bool due(const unsigned long at_us, const unsigned long now_us) {
+  return static_cast<long>(now_us - at_us) >= 0;
+}
+
+static uint32_t movingAverage(const uint32_t average, const uint32_t sample) {
+  return average == 0 ? sample : average - average / 16 + sample / 16;
+}
+
+bool CanTxQueue::push(const CanFrame& frame, const bool periodic, const unsigned long now_us, const bool urgent,
+                      const unsigned long origin_us) {
+  if (periodic) {
+    // a fresher copy of a periodic frame replaces the queued one unless the old one is already on its way
+    for (size_t i = 0; i < count; i++) {
+      if (entries[i].periodic && entries[i].frame.id == frame.id && static_cast<int>(i) != in_flight) {
+        entries[i].frame = frame;
+        entries[i].queued_us = now_us;
+        entries[i].due_us = now_us;
+        entries[i].attempts = 0;
+        if (urgent && !entries[i].urgent) {
+          entries[i].urgent = true;
+          entries[i].origin_us = origin_us;
+        }
+        stats.superseded++;
+        return true;
+      }
+    }
+  }
+  if (count >= can_tx_queue_size) {
+    stats.dropped_full++;
+    return false;
+  }
+  entries[count++] = {frame, now_us, now_us, origin_us, 0, periodic, urgent};
+  return true;
+}
+
+const CanFrame* CanTxQueue::next(const unsigned long now_us) {
+  if (in_flight >= 0) {
+    if (now_us - in_flight_since_us < can_tx_in_flight_timeout_us) {
+      return nullptr;
+    }
+    completed(false, now_us);  // no alert came back, treat it as a failed attempt
+  }
+  int pick = -1;
+  for (size_t i = 0; i < count;) {
+    if (now_us - entries[i].queued_us >= can_tx_deadline_ms * 1000UL) {
+      remove(i);
+      stats.dropped_stale++;
+      continue;
+    }
+    if (due(entries[i].due_us, now_us) && (pick < 0 || entries[i].urgent)) {
+      pick = static_cast<int>(i);
+      if (entries[i].urgent) {
+        break;
+      }
+    }
+    i++;
+  }
+  if (pick < 0) {
+    return nullptr;
+  }
+  in_flight = pick;
+  in_flight_since_us = now_us;
+  return &entries[pick].frame;
+}
+
+void CanTxQueue::submitted(const bool accepted, const unsigned long now_us) {
+  if (in_flight < 0 || accepted) {
+    return;
+  }
+  const auto index = static_cast<size_t>(in_flight);
+  in_flight = -1;
+  retryLater(index, now_us);
+}
+
+void CanTxQueue::completed(const bool success, const unsigned long now_us) {
+  if (in_flight < 0) {
+    return;
+  }
+  const auto index = static_cast<size_t>(in_flight);
+  in_flight = -1;
+  if (!success) {
+    stats.failed_attempts++;
+    retryLater(index, now_us);
+    return;
+  }
+  const auto latency = static_cast<uint32_t>(now_us - entries[index].queued_us);
+  stats.sent++;
+  stats.last_latency_us = latency;
+  if (latency > stats.max_latency_us) {
+    stats.max_latency_us = latency;
+  }
+  stats.avg_latency_us = movingAverage(stats.avg_latency_us, latency);
+  if (entries[index].urgent) {
+    const auto urgent_latency = static_cast<uint32_t>(now_us - entries[index].origin_us);
+    stats.urgent_sent++;
+    if (urgent_latency > stats.urgent_latency_max_us) {
+      stats.urgent_latency_max_us = urgent_latency;
+    }
+    stats.urgent_latency_avg_us = movingAverage(stats.urgent_latency_avg_us, urgent_latency);
+  }
+  remove(index);
+}
+
+unsigned long CanTxQueue::untilNextAttemptUs(const unsigned long now_us) const {
+  if (in_flight >= 0) {
+    const unsigned long elapsed = now_us - in_flight_since_us;
+    return elapsed >= can_tx_in_flight_timeout_us ? 0 : can_tx_in_flight_timeout_us - elapsed;
+  }
+  unsigned long wait = ~0UL;
+  for (size_t i = 0; i < count; i++) {
+    if (due(entries[i].due_us, now_us)) {
+      return 0;
+    }
+    if (entries[i].due_us - now_us < wait) {
+      wait = entries[i].due_us - now_us;
+    }
+  }
+  return wait;
+}
+
+void CanTxQueue::remove(const size_t index) {
+  // keep fifo order, the queue is only a handful of entries long
+  std::memmove(&entries[index], &entries[index + 1], (count - index - 1) * sizeof(Entry));
+  count--;
+}
+
+void CanTxQueue::retryLater(const size_t index, const unsigned long now_us) {
+  Entry& entry = entries[index];
+  if (++entry.attempts >= can_tx_max_attempts) {
+    remove(index);
+    stats.dropped_attempts++;
+    return;
+  }
+  unsigned long backoff = can_tx_retry_base_us << (entry.attempts - 1);
+  if (backoff > can_tx_retry_max_us) {
+    backoff = can_tx_retry_max_us;
+  }
+  entry.due_us = now_us + backoff;
+}
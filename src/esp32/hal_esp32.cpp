@@ -0,0 +1,272 @@
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <Preferences.h>
+#include <PsychicMqttClient.h>
+#include <Update.h>
+#include <WiFi.h>
+#include <driver/twai.h>
+
+#include <cstring>
+
+#include "config.h"
+#include "hal.h"
+#include "main_vars.h"
+
+class Esp32Clock final : public Clock {
+ public:
+  unsigned long millis() override { return ::millis(); }
+  unsigned long micros() override { return ::micros(); }
+};
+
+class Esp32CanDriver final : public CanDriver {
+ public:
+  bool begin(const CanFilter& filter) override {
+    twai_general_config_t g_config =
+        TWAI_GENERAL_CONFIG_DEFAULT((gpio_num_t)can_tx_pin, (gpio_num_t)can_rx_pin, TWAI_MODE_NORMAL);
+    twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS();
+    twai_filter_config_t f_config{filter.acceptance_code, filter.acceptance_mask, filter.single_filter};
+    if (twai_driver_install(&g_config, &t_config, &f_config) == ESP_OK) {
+      Serial.println("Driver installed");
+    } else {
+      Serial.println("Failed to install driver");
+      return false;
+    }
+    if (twai_start() == ESP_OK) {
+      Serial.println("Driver started");
+    } else {
+      Serial.println("Failed to start driver");
+      return false;
+    }
+    constexpr uint32_t alerts_to_enable =
+        TWAI_ALERT_RX_DATA | TWAI_ALERT_ERR_PASS | TWAI_ALERT_BUS_ERROR | TWAI_ALERT_RX_QUEUE_FULL |
+        TWAI_ALERT_TX_SUCCESS | TWAI_ALERT_TX_FAILED;
+    if (twai_reconfigure_alerts(alerts_to_enable, nullptr) == ESP_OK) {
+      Serial.println("CAN Alerts reconfigured");
+    } else {
+      Serial.println("Failed to reconfigure alerts");
+      return false;
+    }
+    return true;
+  }
+
+  bool transmit(const CanFrame& frame) override {
+    twai_message_t message{};
+    message.identifier = frame.id;
+    message.data_length_code = frame.len;
+    message.extd = frame.extd;
+    message.rtr = frame.rtr;
+    message.ss = 1;  // no automatic retransmission, retries are scheduled by the caller
+    std::memcpy(message.data, frame.data, sizeof(message.data));
+    const auto result = twai_transmit(&message, 0);
+    if (result == ESP_OK) {
+      return true;
+    }
+    Serial.print("Failed to queue message for transmission: ");
+    Serial.println(result);
+    return false;
+  }
+
+  bool receive(CanFrame& frame) override {
+    twai_message_t message;
+    if (twai_receive(&message, 0) != ESP_OK) {
+      return false;
+    }
+    frame.id = message.identifier;
+    frame.len = message.data_length_code > 8 ? 8 : message.data_length_code;
+    frame.extd = message.extd;
+    frame.rtr = message.rtr;
+    std::memset(frame.data, 0, sizeof(frame.data));
+    std::memcpy(frame.data, message.data, frame.len);
+    return true;
+  }
+
+  uint32_t readAlerts(const unsigned long timeout_ms) override {
+    uint32_t alerts_triggered = 0;
+    if (twai_read_alerts(&alerts_triggered, pdMS_TO_TICKS(timeout_ms)) != ESP_OK) {
+      return 0;
+    }
+    uint32_t alerts = 0;
+    if (alerts_triggered & TWAI_ALERT_RX_DATA) alerts |= CAN_ALERT_RX_DATA;
+    if (alerts_triggered & TWAI_ALERT_ERR_PASS) alerts |= CAN_ALERT_ERR_PASS;
+    if (alerts_triggered & TWAI_ALERT_BUS_ERROR) alerts |= CAN_ALERT_BUS_ERROR;
+    if (alerts_triggered & TWAI_ALERT_RX_QUEUE_FULL) alerts |= CAN_ALERT_RX_QUEUE_FULL;
+    if (alerts_triggered & TWAI_ALERT_TX_SUCCESS) alerts |= CAN_ALERT_TX_SUCCESS;
+    if (alerts_triggered & TWAI_ALERT_TX_FAILED) alerts |= CAN_ALERT_TX_FAILED;
+    return alerts;
+  }
+
+  void getStatus(CanStatus& status) override {
+    twai_status_info_t twaistatus{};
+    twai_get_status_info(&twaistatus);
+    status.msgs_to_rx = twaistatus.msgs_to_rx;
+    status.rx_missed_count = twaistatus.rx_missed_count;
+    status.rx_overrun_count = twaistatus.rx_overrun_count;
+    status.bus_error_count = twaistatus.bus_error_count;
+  }
+};
+
+class Esp32MqttClient final : public MqttClient {
+ public:
+  void begin(const char* server, const char* user, const char* password, const char* will_topic,
+             ConnectCallback on_connect, MessageCallback on_message) override {
+    client.setServer(server);
+    client.setCredentials(user, password);
+    client.setWill(will_topic, 0, true, "offline");
+    client.setKeepAlive(60);
+    client.onConnect(std::move(on_connect));
+    client.onMessage(std::move(on_message));
+    client.connect();
+  }
+
+  bool connected() override { return client.connected(); }
+
+  void publish(const char* topic, const char* payload, const bool retain) override {
+    client.publish(topic, 0, retain, payload, 0, false);
+  }
+
+  void subscribe(const char* topic) override { client.subscribe(topic, 0); }
+
+ private:
+  PsychicMqttClient client;
+};
+
+class Esp32Logger final : public Logger {
+ public:
+  void write(const char* text) override { Serial.print(text); }
+};
+
+class Esp32Board final : public Board {
+ public:
+  void restart() override { ESP.restart(); }
+
+  void setLed(const bool on) override { digitalWrite(LED_BUILTIN, on ? LED_ON : LED_OFF); }
+
+  const char* hostname() override { return MainVars::hostname.c_str(); }
+
+  void getInfo(BoardInfo& info) override {
+    snprintf(info.wifi, sizeof(info.wifi), "%s", WiFi.SSID().c_str());
+    snprintf(info.ip, sizeof(info.ip), "%s", WiFi.localIP().toString().c_str());
+    snprintf(info.sdk, sizeof(info.sdk), "%s", ESP.getSdkVersion());
+    snprintf(info.cpu, sizeof(info.cpu), "%s rev %d %dx%luMHz", ESP.getChipModel(), ESP.getChipRevision(),
+             ESP.getChipCores(), static_cast<unsigned long>(ESP.getCpuFreqMHz()));
+    snprintf(info.flash, sizeof(info.flash), "%lu MiB, Mode: %d",
+             static_cast<unsigned long>(ESP.getFlashChipSize() / 1024 / 1024), ESP.getFlashChipMode());
+    snprintf(info.heap, sizeof(info.heap), "%lu KiB", static_cast<unsigned long>(ESP.getHeapSize() / 1024));
+    snprintf(info.psram, sizeof(info.psram), "%lu KiB", static_cast<unsigned long>(ESP.getPsramSize() / 1024));
+  }
+
+  void getMemory(MemoryInfo& memory) override {
+    memory.free_heap = ESP.getFreeHeap();
+    memory.largest_free_block = ESP.getMaxAllocHeap();
+    memory.min_free_heap = ESP.getMinFreeHeap();
+  }
+
+  uint32_t stackFree() override { return uxTaskGetStackHighWaterMark(nullptr); }  // esp-idf counts in bytes
+
+  bool startTask(void (*fn)(void*), const char* name, const uint32_t stack_size, const uint8_t priority,
+                 void* arg) override {
+    auto* start = new TaskStart{fn, arg};
+    if (xTaskCreate(run, name, stack_size, start, priority, nullptr) == pdPASS) {
+      return true;
+    }
+    delete start;
+    return false;
+  }
+
+ private:
+  struct TaskStart {
+    void (*fn)(void*);
+    void* arg;
+  };
+
+  // a freertos task must not return, finished ones delete themselves
+  static void run(void* arg) {
+    const TaskStart start = *static_cast<TaskStart*>(arg);
+    delete static_cast<TaskStart*>(arg);
+    start.fn(start.arg);
+    vTaskDelete(nullptr);
+  }
+};
+
+class Esp32Updater final : public Updater {
+ public:
+  bool begin(const char* path, uint32_t& size, char* message, const size_t message_size) override {
+    secure_client.setCACert(trustRoot);
+    secure_client.setTimeout(ota_stall_timeout_ms);
+    if (!http.begin(secure_client, String("https://") + ota_server + path)) {
+      snprintf(message, message_size, "ota connect failed");
+      return false;
+    }
+    const int code = http.GET();
+    const int length = http.getSize();
+    if (code != HTTP_CODE_OK || length <= 0) {
+      snprintf(message, message_size, "ota http %d, size %d", code, length);
+      http.end();
+      return false;
+    }
+    if (!Update.begin(length, U_FLASH)) {
+      snprintf(message, message_size, "ota update begin failed: %s", Update.errorString());
+      http.end();
+      return false;
+    }
+    stream = http.getStreamPtr();
+    size = length;
+    return true;
+  }
+
+  int read(uint8_t* buffer, const size_t size) override {
+    if (!http.connected() && stream->available() <= 0) {
+      return -1;
+    }
+    // blocks this task until the chunk is full or the stream went quiet for the client timeout
+    return static_cast<int>(stream->readBytes(buffer, size));
+  }
+
+  bool write(const uint8_t* buffer, const size_t size) override {
+    return Update.write(const_cast<uint8_t*>(buffer), size) == size;
+  }
+
+  bool end(const bool commit, char* message, const size_t message_size) override {
+    http.end();
+    if (!commit) {
+      Update.abort();
+      return false;
+    }
+    const bool ok = Update.end();
+    snprintf(message, message_size, "ota %s", ok ? "ok" : Update.errorString());
+    return ok;
+  }
+
+ private:
+  NetworkClientSecure secure_client;
+  HTTPClient http;
+  NetworkClient* stream = nullptr;
+};
+
+class Esp32Storage final : public Storage {
+ public:
+  bool load(const char* key, void* data, const size_t size) override {
+    return open() && preferences.getBytesLength(key) == size && preferences.getBytes(key, data, size) == size;
+  }
+
+  bool save(const char* key, const void* data, const size_t size) override {
+    return open() && preferences.putBytes(key, data, size) == size;
+  }
+
+ private:
+  Preferences preferences;
+  bool opened = false;
+
+  bool open() { return opened || (opened = preferences.begin("espcan", false)); }
+};
+
+static Esp32Clock esp32_clock;
+static Esp32CanDriver esp32_can_driver;
+static Esp32MqttClient esp32_mqtt_client;
+static Esp32Logger esp32_logger;
+static Esp32Board esp32_board;
+static Esp32Storage esp32_storage;
+static Esp32Updater esp32_updater;
+
+Hal hal = {&esp32_clock, &esp32_can_driver, &esp32_mqtt_client, &esp32_logger, &esp32_board, &esp32_storage,
+           &esp32_updater};
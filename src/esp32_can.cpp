@@ -1,90 +1,72 @@
 #include "esp32_can.h"
 
-#include "can_manager.h"
-#include "main_vars.h"
-#include "mqtt_manager.h"
+#include <cstring>
 
-bool ESP32Can::init() {
-  twai_general_config_t g_config =
-      TWAI_GENERAL_CONFIG_DEFAULT((gpio_num_t)can_tx_pin, (gpio_num_t)can_rx_pin, TWAI_MODE_NORMAL);
-  twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS();
-  twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
-  if (twai_driver_install(&g_config, &t_config, &f_config) == ESP_OK) {
-    Serial.println("Driver installed");
-  } else {
-    Serial.println("Failed to install driver");
-    MqttManager::log("Failed to install can driver...");
-    return false;
-  }
-  if (twai_start() == ESP_OK) {
-    Serial.println("Driver started");
-  } else {
-    Serial.println("Failed to start driver");
-    MqttManager::log("Failed to start can driver...");
-    return false;
-  }
-  constexpr uint32_t alerts_to_enable =
-      TWAI_ALERT_RX_DATA | TWAI_ALERT_ERR_PASS | TWAI_ALERT_BUS_ERROR | TWAI_ALERT_RX_QUEUE_FULL;
-  if (twai_reconfigure_alerts(alerts_to_enable, nullptr) == ESP_OK) {
-    Serial.println("CAN Alerts reconfigured");
-  } else {
-    Serial.println("Failed to reconfigure alerts");
+#include "battery.h"
+
+ESP32Can::ESP32Can(Battery& battery) : battery(battery), hal(battery.hal) {}
+
+bool ESP32Can::init(const CanFilter& filter) {
+  if (!hal.can->begin(filter)) {
+    battery.events.log("Failed to start can driver...");
     return false;
   }
   return true;
 }
 
-bool ESP32Can::send(const uint32_t id, const uint8_t len, const uint8_t* buf) {
-  Serial.printf("send: Standard ID: 0x%.3lX       DLC: %1d  Data:", id, len);
-  for (byte i = 0; i < len; i++) {
-    Serial.printf(" 0x%.2X", buf[i]);
-  }
-  Serial.println();
-  twai_message_t message;
-  message.identifier = id;
-  message.data_length_code = len;
-  for (int i = 0; i < len; i++) {
-    message.data[i] = buf[i];
-  }
-  message.extd = 0;
-  message.rtr = 0;
+bool ESP32Can::send(const uint32_t id, const uint8_t len, const uint8_t* buf, const bool periodic, const bool urgent,
+                    const unsigned long origin_us) {
+  CanFrame frame{};
+  frame.id = id;
+  frame.len = len;
+  std::memcpy(frame.data, buf, len);
+  frame.extd = false;
+  frame.rtr = false;
 
   // Queue message for transmission
-  const auto result = twai_transmit(&message, pdMS_TO_TICKS(1000));
-  if (result == ESP_OK) {
-    return true;
+  if (!tx_queue.push(frame, periodic, hal.clock->micros(), urgent, origin_us)) {
+    battery.events.log("Failed to queue can message for transmission");
+    return false;
   }
-  Serial.print("Failed to queue message for transmission: ");
-  Serial.println(result);
-  MqttManager::log("Failed to queue can message for transmission" + result);
-  return false;
+  pumpTx();
+  return true;
 }
 
-void ESP32Can::loop() {
-  uint32_t alerts_triggered;
-  twai_read_alerts(&alerts_triggered, 0);
-  twai_status_info_t twaistatus;
-  twai_get_status_info(&twaistatus);
-  if (alerts_triggered & TWAI_ALERT_ERR_PASS) {
-    Serial.println("Alert: TWAI controller has become error passive.");
-    MqttManager::log("Alert: TWAI controller has become error passive.");
-  }
-  if (alerts_triggered & TWAI_ALERT_BUS_ERROR) {
-    Serial.println("Alert: A (Bit, Stuff, CRC, Form, ACK) error has occurred on the bus.");
-    Serial.printf("Bus error count: %d\n", twaistatus.bus_error_count);
-    MqttManager::log("Alert: A (Bit, Stuff, CRC, Form, ACK) error has occurred on the bus.");
+void ESP32Can::pumpTx() {
+  const unsigned long now = hal.clock->micros();
+  if (const CanFrame* frame = tx_queue.next(now)) {
+    tx_queue.submitted(hal.can->transmit(*frame), now);
   }
-  if (alerts_triggered & TWAI_ALERT_RX_QUEUE_FULL) {
-    Serial.println("Alert: The RX queue is full causing a received frame to be lost.");
-    Serial.printf("RX buffered: %d\t", twaistatus.msgs_to_rx);
-    Serial.printf("RX missed: %d\t", twaistatus.rx_missed_count);
-    Serial.printf("RX overrun %d\n", twaistatus.rx_overrun_count);
-    MqttManager::log("Alert: The RX queue is full causing a received frame to be lost.");
+}
+
+unsigned long ESP32Can::untilNextTxMs() {
+  const unsigned long wait_us = tx_queue.untilNextAttemptUs(hal.clock->micros());
+  return wait_us == ~0UL ? ~0UL : (wait_us + 999UL) / 1000UL;
+}
+
+void ESP32Can::loop(const unsigned long alert_timeout_ms) {
+  const uint32_t alerts_triggered = hal.can->readAlerts(alert_timeout_ms);
+  if (alerts_triggered & (CAN_ALERT_TX_SUCCESS | CAN_ALERT_TX_FAILED)) {
+    if (const CanFrame* frame = tx_queue.inFlightFrame(); frame && (alerts_triggered & CAN_ALERT_TX_SUCCESS)) {
+      // only what made it onto the bus, a capture must not show retried or dropped attempts as frames
+      battery.trace.record(CanTrace::tx, *frame);
+      battery.monitor.frame(BusMonitor::tx, *frame);
+    }
+    tx_queue.completed(alerts_triggered & CAN_ALERT_TX_SUCCESS, hal.clock->micros());
+    if ((alerts_triggered & CAN_ALERT_TX_SUCCESS) && !battery.boot.reached(BootTimeline::first_can_tx)) {
+      battery.boot.mark(BootTimeline::first_can_tx, hal.clock->micros());
+      hal.log->printf("first can frame on the bus after %lu us\n", battery.boot.at(BootTimeline::first_can_tx));
+    }
   }
-  if (alerts_triggered & TWAI_ALERT_RX_DATA) {
-    twai_message_t message;
-    while (twai_receive(&message, 0) == ESP_OK) {
-      CanManager::readMessage(message);
+  pumpTx();
+  hal.can->getStatus(status);
+  // error alerts are only counted, the monitor reports them once per interval instead of a log line each
+  battery.monitor.alerts(alerts_triggered, status);
+  if (alerts_triggered & CAN_ALERT_RX_DATA) {
+    CanFrame frame;
+    while (hal.can->receive(frame)) {
+      battery.monitor.frame(BusMonitor::rx, frame);
+      battery.can.readMessage(frame);
     }
   }
 }
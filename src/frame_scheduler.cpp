@@ -0,0 +1,152 @@
+#include "frame_scheduler.h"
+
+bool FrameScheduler::add(const uint32_t id, const Send send, void* context, const unsigned long period_ms) {
+  if (count >= can_schedule_size || period_ms == 0 || find(id)) {
+    return false;
+  }
+  Task& task = tasks[count++];
+  task.id = id;
+  task.send = send;
+  task.context = context;
+  task.default_period_ms = period_ms;
+  task.period_us = period_ms * 1000ULL;
+  return true;
+}
+
+// micros() is 32 bit on the esp32 and wraps after ~71 minutes, run() is called far more often than that
+uint64_t FrameScheduler::extend(const unsigned long now_us) const {
+  if (sizeof(unsigned long) >= sizeof(uint64_t)) {
+    return now_us;
+  }
+  uint64_t now = (last_us & ~0xFFFFFFFFULL) | now_us;
+  if (now < last_us) {
+    now += 1ULL << 32;
+  }
+  return now;
+}
+
+void FrameScheduler::start(const unsigned long now_us) {
+  last_us = extend(now_us);
+  start_us = last_us;
+  // spread all tasks evenly over the shortest period, so any two frames are at least that / count apart
+  uint64_t shortest = ~0ULL;
+  for (size_t i = 0; i < count; i++) {
+    if (tasks[i].period_us < shortest) {
+      shortest = tasks[i].period_us;
+    }
+  }
+  for (size_t i = 0; i < count; i++) {
+    tasks[i].stagger_us = shortest * i / count;
+    tasks[i].phase_us = tasks[i].stagger_us;
+    tasks[i].due_us = start_us + tasks[i].phase_us;
+  }
+}
+
+// first slot of the task's grid (start + phase + k * period) that is not in the past, the stats keep counting
+void FrameScheduler::apply(Task& task, const uint64_t now) {
+  task.period_us = task.pending_period_ms * 1000ULL;
+  task.phase_us = task.pending_phase_ms == ~0UL ? task.stagger_us : task.pending_phase_ms * 1000ULL;
+  task.phase_us %= task.period_us;
+  const uint64_t first = start_us + task.phase_us;
+  task.due_us = now <= first ? first : first + ((now - first + task.period_us - 1) / task.period_us) * task.period_us;
+}
+
+void FrameScheduler::run(const unsigned long now_us) {
+  const uint64_t now = extend(now_us);
+  last_us = now;
+  for (size_t i = 0; i < count; i++) {
+    Task& task = tasks[i];
+    if (task.pending.exchange(false, std::memory_order_acquire)) {
+      apply(task, now);
+    }
+    const bool due = now >= task.due_us;
+    // a trigger is served by the next grid slot when that comes first, otherwise once the spacing allows
+    const bool triggered = task.triggered.load(std::memory_order_acquire) &&
+                           (due || now - task.last_run_us >= can_trigger_min_spacing_ms * 1000ULL);
+    if (!due && !triggered) {
+      continue;
+    }
+    unsigned long trigger_us = 0;
+    if (triggered) {
+      trigger_us = task.trigger_us.load(std::memory_order_relaxed);
+      task.triggered.store(false, std::memory_order_release);
+      task.stats.triggered++;
+    }
+    task.last_run_us = now;
+    if (!due) {
+      task.send(task.context, true, trigger_us);
+      continue;
+    }
+    const uint64_t late = now - task.due_us;
+    task.stats.runs++;
+    task.stats.jitter_max_us = late > task.stats.jitter_max_us ? static_cast<uint32_t>(late) : task.stats.jitter_max_us;
+    task.stats.jitter_avg_us = task.stats.runs == 1 ? static_cast<uint32_t>(late)
+                                                    : task.stats.jitter_avg_us - task.stats.jitter_avg_us / 16 +
+                                                          static_cast<uint32_t>(late / 16);
+    // stay on the grid, periods that passed completely are skipped instead of sent back to back
+    const uint64_t missed = late / task.period_us;
+    task.stats.skipped += static_cast<uint32_t>(missed);
+    task.due_us += (missed + 1) * task.period_us;
+    task.send(task.context, triggered, trigger_us);
+  }
+}
+
+unsigned long FrameScheduler::untilNextUs(const unsigned long now_us) const {
+  const uint64_t now = extend(now_us);
+  uint64_t wait = ~0ULL;
+  for (size_t i = 0; i < count; i++) {
+    if (tasks[i].pending.load(std::memory_order_relaxed)) {
+      return 0;
+    }
+    uint64_t remaining = tasks[i].due_us > now ? tasks[i].due_us - now : 0;
+    if (tasks[i].triggered.load(std::memory_order_relaxed)) {
+      const uint64_t spaced = tasks[i].last_run_us + can_trigger_min_spacing_ms * 1000ULL;
+      const uint64_t until_spaced = spaced > now ? spaced - now : 0;
+      if (until_spaced < remaining) {
+        remaining = until_spaced;
+      }
+    }
+    if (remaining < wait) {
+      wait = remaining;
+    }
+  }
+  return wait > ~0UL ? ~0UL : static_cast<unsigned long>(wait);
+}
+
+bool FrameScheduler::configure(const uint32_t id, const unsigned long period_ms, const unsigned long phase_ms) {
+  Task* task = const_cast<Task*>(find(id));
+  if (task == nullptr || period_ms < can_schedule_min_period_ms) {
+    return false;  // a 1 ms period would flood the bus
+  }
+  task->pending_period_ms = period_ms;
+  task->pending_phase_ms = phase_ms;
+  task->pending.store(true, std::memory_order_release);
+  return true;
+}
+
+bool FrameScheduler::reset(const uint32_t id) {
+  const Task* task = find(id);
+  return task != nullptr && configure(id, task->default_period_ms);
+}
+
+bool FrameScheduler::trigger(const uint32_t id, const unsigned long now_us) {
+  Task* task = const_cast<Task*>(find(id));
+  if (task == nullptr) {
+    return false;
+  }
+  // requests before the run merge into one, the latency counts from the first of them
+  if (!task->triggered.load(std::memory_order_acquire)) {
+    task->trigger_us.store(now_us, std::memory_order_relaxed);
+    task->triggered.store(true, std::memory_order_release);
+  }
+  return true;
+}
+
+const FrameScheduler::Task* FrameScheduler::find(const uint32_t id) const {
+  for (size_t i = 0; i < count; i++) {
+    if (tasks[i].id == id) {
+      return &tasks[i];
+    }
+  }
+  return nullptr;
+}
@@ -0,0 +1,18 @@
+#include "hal.h"
+
+#include <cstdarg>
+#include <cstdio>
+
+void Logger::printf(const char* format, ...) {
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  write(buffer);
+}
+
+void Logger::println(const char* text) {
+  write(text);
+  write("\n");
+}
@@ -1,27 +1,26 @@
 #include <Arduino.h>
 
-#include "can_manager.h"
+#include "battery.h"
 #include "config.h"
+#include "hal.h"
 #include "main_vars.h"
-#include "mqtt_manager.h"
 #include "wifi_manager.h"
 
+static Battery battery(hal);
+
 void setup() {
   Serial.begin(74880);
 
   pinMode(LED_BUILTIN, OUTPUT);
   digitalWrite(LED_BUILTIN, LED_ON);
 
-  WifiManager::connect();
-  WifiManager::syncTime();
-
-  MqttManager::init();
-  CanManager::init();
+  battery.begin();  // twai and the limit frames first, after a brownout the inverter must not wait for the network
+  WifiManager::begin();
 
   digitalWrite(LED_BUILTIN, LED_OFF);
 }
 
 void loop() {
-  MqttManager::loop();
-  CanManager::loop();
+  WifiManager::loop(battery);
+  battery.loop();
 }
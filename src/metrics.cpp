@@ -0,0 +1,84 @@
+#include "metrics.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "battery.h"
+
+Metrics::Metrics(Battery& battery) : battery(battery), hal(battery.hal) {}
+
+void Metrics::recordLoop(const unsigned long duration_us) {
+  unsigned int bucket = 0;
+  while (bucket < loop_buckets - 1 && duration_us >= (1UL << bucket)) {
+    bucket++;
+  }
+  loop_histogram[bucket]++;
+  loop_count++;
+  if (duration_us > loop_max_us) {
+    loop_max_us = duration_us;
+  }
+}
+
+void Metrics::setInterval(const unsigned long ms) {
+  interval_ms = ms;
+  memset(loop_histogram, 0, sizeof(loop_histogram));
+  loop_count = 0;
+  loop_max_us = 0;
+  last_publish_time = hal.clock->millis();
+}
+
+void Metrics::loop() {
+  if (interval_ms == 0 || hal.clock->millis() - last_publish_time < interval_ms) {
+    return;
+  }
+  last_publish_time = hal.clock->millis();
+  if (hal.mqtt->connected()) {
+    publish();
+  }
+  memset(loop_histogram, 0, sizeof(loop_histogram));
+  loop_count = 0;
+  loop_max_us = 0;
+}
+
+// loop figures cover the last interval, everything else counts since boot
+void Metrics::publish() {
+  MemoryInfo memory{};
+  hal.board->getMemory(memory);
+  const CanStatus& twai = battery.bus.lastStatus();  // written by the can task, single words are good enough here
+  const CanTxStats& tx = battery.bus.txStats();
+  const MqttQueueStats& queue = battery.mqtt.queue_stats;
+
+  char json[832];  // every field at its widest
+  int pos = snprintf(json, sizeof(json), "{\"uptime_ms\":%lu,\"loop\":{\"count\":%lu,\"max_us\":%lu,\"histogram\":[",
+                     hal.clock->millis(), static_cast<unsigned long>(loop_count),
+                     static_cast<unsigned long>(loop_max_us));
+  for (unsigned int i = 0; i < loop_buckets && pos > 0 && static_cast<size_t>(pos) < sizeof(json); i++) {
+    pos += snprintf(json + pos, sizeof(json) - pos, i ? ",%lu" : "%lu", static_cast<unsigned long>(loop_histogram[i]));
+  }
+  if (pos > 0 && static_cast<size_t>(pos) < sizeof(json)) {
+    snprintf(json + pos, sizeof(json) - pos,
+             "]},\"can_tx\":{\"sent\":%lu,\"failed_attempts\":%lu,\"dropped\":%lu,\"dropped_attempts\":%lu,"
+             "\"latency_avg_us\":%lu,\"latency_max_us\":%lu},"
+             "\"mqtt\":{\"depth\":%u,\"high_water\":%u,\"evicted\":%lu,\"dropped\":%lu,\"oversized\":%lu,"
+             "\"inbound_dropped\":%lu,\"max_drain_us\":%lu},"
+             "\"heap\":{\"free\":%lu,\"largest_block\":%lu,\"min_free\":%lu},"
+             "\"twai\":{\"rx_missed\":%lu,\"rx_overrun\":%lu,\"bus_errors\":%lu},\"events_dropped\":%lu,"
+             "\"trace_dropped\":%lu}",
+             static_cast<unsigned long>(tx.sent), static_cast<unsigned long>(tx.failed_attempts),
+             static_cast<unsigned long>(tx.dropped_stale + tx.dropped_full),
+             static_cast<unsigned long>(tx.dropped_attempts),
+             static_cast<unsigned long>(tx.avg_latency_us), static_cast<unsigned long>(tx.max_latency_us),
+             static_cast<unsigned int>(battery.mqtt.queueDepth()), static_cast<unsigned int>(queue.depth_high_water),
+             static_cast<unsigned long>(battery.mqtt.queueEvicted()),
+             static_cast<unsigned long>(battery.mqtt.queueDropped()),
+             static_cast<unsigned long>(battery.mqtt.queueOversized()),
+             static_cast<unsigned long>(battery.mqtt.inbound_dropped.load(std::memory_order_relaxed)),
+             static_cast<unsigned long>(queue.max_drain_us),
+             static_cast<unsigned long>(memory.free_heap), static_cast<unsigned long>(memory.largest_free_block),
+             static_cast<unsigned long>(memory.min_free_heap), static_cast<unsigned long>(twai.rx_missed_count),
+             static_cast<unsigned long>(twai.rx_overrun_count), static_cast<unsigned long>(twai.bus_error_count),
+             static_cast<unsigned long>(battery.events.dropped), static_cast<unsigned long>(battery.trace.dropped));
+  }
+  // too long for the queue slots, goes out directly
+  battery.mqtt.publish("metrics", json, false, false);
+}
@@ -1,212 +1,412 @@
 #include "mqtt_manager.h"
 
-#include <HTTPClient.h>
-#include <HTTPUpdate.h>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
 
-#include <map>
-#include <set>
-
-#include "can_manager.h"
+#include "battery.h"
 #include "config.h"
+#include "fixed_point.h"
+#include "hal.h"
 #include "main_vars.h"
+#include "perfect_hash.h"
 
-PsychicMqttClient MqttManager::client;
+static_assert(max_ota_path_length <= max_mqtt_inbound_payload_length, "an ota command must fit the inbound queue");
 
-String MqttManager::module_topic = mqtt_topic;
-String MqttManager::will_topic;
+static constexpr bool startsWith(const std::string_view text, const std::string_view prefix) {
+  return text.size() >= prefix.size() && text.substr(0, prefix.size()) == prefix;
+}
 
-unsigned long MqttManager::last_blink_time = 0;
-unsigned long MqttManager::last_master_heartbeat_time = 0;
+static constexpr bool endsWith(const std::string_view text, const std::string_view suffix) {
+  return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
 
-struct QueuedMessage {
-  String topic;
-  String payload;
-  bool retain;
-  int priority;
-};
+MqttManager::MqttManager(Battery& battery, const char* module_topic)
+    : battery(battery), hal(battery.hal), module_topic(module_topic) {}
 
-struct MessageComparator {
-  bool operator()(const QueuedMessage& a, const QueuedMessage& b) const {
-    return a.priority > b.priority;  // high priority first
+void MqttManager::init() {
+  if (module_topic.empty()) {
+    module_topic = std::string(hal.board->hostname()) + "/";
   }
-};
+  will_topic = module_topic + "available";
+  log_topic = registerTopic("log");
+  battery.telemetry.init();
+  last_master_heartbeat_time = hal.clock->millis();
+}
 
-static std::multiset<QueuedMessage, MessageComparator> messageQueue;
+void MqttManager::connect() {
+  hal.mqtt->begin(
+      mqtt_server, mqtt_user, mqtt_password, will_topic.c_str(),
+      [this](bool) {
+        connected_us = hal.clock->micros();
+        connect_pending.store(true, std::memory_order_release);
+      },
+      [this](char* topic, char* payload, int, int, bool) { receive(topic, payload); });
+}
 
-void MqttManager::init() {
-  if (module_topic.length() <= 0) {
-    module_topic = MainVars::hostname + "/";
+// client task: the heartbeat is a single atomic store, everything else is copied for loop()
+void MqttManager::receive(const char* topic, const char* payload) {
+  if (strcmp(topic, mqtt_master_heartbeat_topic) == 0) {
+    last_master_heartbeat_time = hal.clock->millis();
+    return;
+  }
+  MqttInbound message;
+  const size_t topic_length = strlen(topic);
+  const size_t payload_length = strlen(payload);
+  if (topic_length >= sizeof(message.topic) || payload_length >= sizeof(message.payload)) {
+    inbound_dropped++;
+    return;
+  }
+  memcpy(message.topic, topic, topic_length + 1);
+  memcpy(message.payload, payload, payload_length + 1);
+  if (!inbound.push(message)) {
+    inbound_dropped++;
   }
-  client.setServer(mqtt_server);
-  client.setCredentials(mqtt_user, mqtt_password);
-  will_topic = module_topic + "available";
-  client.setWill(will_topic.c_str(), 0, true, "offline");
-  client.setKeepAlive(60);
-  client.onConnect(onConnect);
-  client.onMessage(onMessage);
-  client.connect();
-  last_master_heartbeat_time = millis();
 }
 
-void MqttManager::loop() {
-  if (millis() - last_blink_time < blink_time) {
-    if ((millis() - last_blink_time) % 100 < 50) {
-      digitalWrite(LED_BUILTIN, LED_OFF);
-    } else {
-      digitalWrite(LED_BUILTIN, LED_ON);
+void MqttManager::handleInbound() {
+  if (connect_pending.exchange(false, std::memory_order_acq_rel)) {
+    onConnect();
+  }
+  MqttInbound message;
+  while (inbound.pop(message)) {
+    onMessage(message.topic, message.payload);
+  }
+  const uint32_t dropped = inbound_dropped.load(std::memory_order_relaxed);
+  if (dropped != inbound_dropped_logged) {
+    hal.log->printf("mqtt inbound: %lu commands dropped\n",
+                    static_cast<unsigned long>(dropped - inbound_dropped_logged));
+    inbound_dropped_logged = dropped;
+  }
+}
+
+TopicHandle MqttManager::registerTopic(const char* topic) {
+  char full_topic[max_mqtt_topic_length];
+  const int length = snprintf(full_topic, sizeof(full_topic), "%s%s", module_topic.c_str(), topic);
+  if (length < 0 || static_cast<size_t>(length) >= sizeof(full_topic)) {
+    hal.log->printf("topic %s%s too long\n", module_topic.c_str(), topic);
+    return invalid_topic;
+  }
+  for (TopicHandle handle = 0; handle < topic_count; handle++) {
+    if (strcmp(topic_table[handle], full_topic) == 0) {
+      return handle;
     }
   }
+  if (topic_count >= max_mqtt_interned_topics) {
+    hal.log->printf("topic table full, %s not interned\n", full_topic);
+    return invalid_topic;
+  }
+  memcpy(topic_table[topic_count], full_topic, sizeof(full_topic));
+  return topic_count++;
+}
+
+void MqttManager::loop() {
+  handleInbound();
+  const unsigned long now = hal.clock->millis();
+  if (now - last_blink_time < blink_time) {
+    hal.board->setLed((now - last_blink_time) % 100 >= 50);
+  }
   unsigned long last_heartbeat = last_master_heartbeat_time;
-  unsigned long delta = millis() - last_heartbeat;
+  unsigned long delta = now - last_heartbeat;
   if (delta >= heartbeat_timeout_reboot_ms) {
-    log(String("DEBUG check: delta=") + String(delta) + ", limit=" + String(heartbeat_timeout_reboot_ms), false);
-    log(String(millis()) + " : " + String(last_heartbeat), false);
+    char line[64];
+    snprintf(line, sizeof(line), "DEBUG check: delta=%lu, limit=%lu", delta, heartbeat_timeout_reboot_ms);
+    log(line, false);
+    snprintf(line, sizeof(line), "%lu : %lu", now, last_heartbeat);
+    log(line, false);
     log("master heartbeat timeout - restarting!", false);
-    ESP.restart();
+    battery.store.flush();
+    hal.board->restart();
   }
-  if (!client.connected() || messageQueue.empty()) {
+  if (!hal.mqtt->connected() || messageQueue.empty()) {
     return;
   }
-  const auto it = messageQueue.begin();
-  const QueuedMessage& msg = *it;  // highest priority message
-  client.publish(msg.topic.c_str(), 0, msg.retain, msg.payload.c_str(), 0, false);
-  messageQueue.erase(it);
-}
-
-void MqttManager::otaUpdate(const String& path) {
-  log(String("ota started [") + path + "] (" + millis() + ")", false);
-  NetworkClientSecure secure_client;
-  secure_client.setCACert(trustRoot);
-  secure_client.setTimeout(12UL * 1000UL);
-  httpUpdate.setLedPin(LED_BUILTIN, LED_ON);
-  switch (httpUpdate.update(secure_client, String("https://") + ota_server + path)) {
-    case HTTP_UPDATE_FAILED: {
-      auto error_string = String("HTTP_UPDATE_FAILED Error (");
-      error_string += httpUpdate.getLastError();
-      error_string += "): ";
-      error_string += httpUpdate.getLastErrorString();
-      error_string += "\n";
-      Serial.println(error_string);
-      log(error_string, false);
-    } break;
-    case HTTP_UPDATE_NO_UPDATES:
-      Serial.println("HTTP_UPDATE_NO_UPDATES");
-      log("HTTP_UPDATE_NO_UPDATES", false);
-      break;
-    case HTTP_UPDATE_OK:
-      Serial.println("HTTP_UPDATE_OK");
-      log("HTTP_UPDATE_OK", false);
-      break;
+  // publish highest priority messages first until the message or time budget of this iteration is used up
+  const unsigned long start_us = hal.clock->micros();
+  const auto depth = static_cast<uint16_t>(messageQueue.size());
+  uint16_t drained = 0;
+  unsigned long elapsed_us = 0;
+  do {
+    const auto& msg = messageQueue.front();
+    hal.mqtt->publish(msg.topic, msg.payload, msg.retain);
+    messageQueue.pop();
+    drained++;
+    elapsed_us = hal.clock->micros() - start_us;
+  } while (!messageQueue.empty() && (drain_max_messages == 0 || drained < drain_max_messages) &&
+           (drain_budget_us == 0 || elapsed_us < drain_budget_us));
+  queue_stats.drained_total += drained;
+  queue_stats.drain_calls++;
+  queue_stats.last_drained = drained;
+  queue_stats.last_depth = depth;
+  if (elapsed_us > queue_stats.max_drain_us) {
+    queue_stats.max_drain_us = elapsed_us;
   }
 }
 
-void MqttManager::onMessage(char* topic, char* payload, int retain, int qos, bool dup) {
-  String sTopic(topic);
-  if (sTopic.startsWith(module_topic)) {
-    sTopic = sTopic.substring(module_topic.length());
+// control topics relative to module_topic in MqttManager::Control order, matched with one hash and one compare
+static constexpr std::array<std::string_view, 8> control_topics = {
+    "ota", "trace", "blink", "restart", "telemetry/mode/set", "metrics/interval/set", "soc_model/enabled/set",
+    "unknown/dump/set",
+};
+static constexpr PerfectHash<control_topics.size(), 16> control_hash(control_topics);
+static_assert(control_hash.valid(), "no collision free seed for the control topics");
+
+void MqttManager::onMessage(const char* topic, const char* payload) {
+  // views into the inbound copy all the way down, nothing else is copied or allocated per message
+  std::string_view sTopic(topic);
+  const std::string_view sPayload(payload);
+  if (startsWith(sTopic, module_topic)) {
+    sTopic.remove_prefix(module_topic.length());
   }
-  if (sTopic.equals("ota")) {
-    otaUpdate(payload);
+  const int control = control_hash.find(sTopic);
+  if (control >= 0) {
+    onControl(static_cast<Control>(control), payload, sPayload);
     return;
   }
-  if (sTopic.equals("blink")) {
-    last_blink_time = millis();
+  const bool isSet = endsWith(sTopic, "/set");
+  const bool isReset = !isSet && endsWith(sTopic, "/reset");
+  if (!isSet && !isReset) {
     return;
   }
-  if (sTopic.equals(mqtt_master_heartbeat_topic)) {
-    last_master_heartbeat_time = millis();
+  sTopic.remove_suffix(isSet ? 4 : 6);
+  if (startsWith(sTopic, "schedule/")) {
+    sTopic.remove_prefix(9);
+    onSchedule(sTopic, payload, isSet);
     return;
   }
-  if (sTopic.equals("restart")) {
-    log("restart requested - restarting!", false);
-    ESP.restart();
-  }
-  const bool isSet = sTopic.endsWith("/set");
-  const bool isReset = sTopic.endsWith("/reset");
-  char* endPtr;
-  const float value = strtof(payload, &endPtr);
-  if (isSet && *endPtr != '\0') {
-    log(String("failed to parse ") + payload + " of topic " + sTopic + ".");
+  const Telemetry::Id id = Telemetry::find(sTopic);
+  if (id == Telemetry::count || battery.can.settings[id].valuePtr == nullptr) {
     return;
   }
-  if (!isSet && !isReset) return;
+  const ValueConfig& setting = battery.can.settings[id];
+  float value = setting.defaultValue;
   if (isSet) {
-    sTopic = sTopic.substring(0, sTopic.length() - 4);
+    int32_t scaled;
+    if (!parseFixed(sPayload, Telemetry::decimals(id), scaled)) {
+      char line[128];
+      snprintf(line, sizeof(line), "failed to parse %s of topic %s.", payload, topic);
+      log(line);
+      return;
+    }
+    value = static_cast<float>(scaled) / static_cast<float>(decimalScale(Telemetry::decimals(id)));
+  }
+  if (id == Telemetry::battery_soc) {
+    battery.can.setSoc(value);  // the soc model writes soc_percent on the can task
   } else {
-    sTopic = sTopic.substring(0, sTopic.length() - 6);
+    *setting.valuePtr = value;
   }
-  const auto it = CanManager::value_map.find(sTopic);
-  if (it == CanManager::value_map.end()) {
-    return;
+  if (id <= Telemetry::limits_max_charge_current) {
+    battery.can.triggerLimits();  // derating must not wait for the next 0x110 slot
   }
-  if (isSet) {
-    *it->second.valuePtr = value;
+}
+
+void MqttManager::onControl(const Control control, const char* payload, const std::string_view sPayload) {
+  switch (control) {
+    case Control::ota: {
+      // returns right away, the download runs in the background and reports on ota/progress and the log topic
+      char line[max_ota_path_length + 32];
+      snprintf(line, sizeof(line), "ota %s [%s] (%lu)", battery.ota.start(payload) ? "started" : "refused", payload,
+               hal.clock->millis());
+      log(line, false);
+      break;
+    }
+    case Control::trace:
+      if (sPayload == "on" || sPayload == "off") {
+        battery.trace.serial_enabled = sPayload == "on";
+      } else {
+        battery.trace.dump(sPayload == "candump" ? CanTrace::candump : CanTrace::text);
+      }
+      break;
+    case Control::blink:
+      last_blink_time = hal.clock->millis();
+      break;
+    case Control::restart:
+      log("restart requested - restarting!", false);
+      battery.store.flush();
+      hal.board->restart();
+      break;
+    case Control::telemetry_mode:
+      if (!battery.telemetry.setMode(payload)) {
+        log("unknown telemetry mode");
+      }
+      break;
+    case Control::metrics_interval: {
+      int32_t interval_ms;
+      if (parseFixed(sPayload, 0, interval_ms) && interval_ms >= 0) {
+        battery.metrics.setInterval(static_cast<unsigned long>(interval_ms));
+      }
+      break;
+    }
+    case Control::soc_model: {
+      const bool enabled = sPayload == "on" || sPayload == "1";
+      battery.can.soc_model.enabled = enabled;
+      log(enabled ? "soc model on" : "soc model off");
+      break;
+    }
+    case Control::unknown:
+      battery.unknown.dump();
+      break;
+  }
+}
+
+// schedule/<hex id>/set with "period_ms" or "period_ms,phase_ms", schedule/<hex id>/reset for the defaults
+void MqttManager::onSchedule(const std::string_view id_text, const char* payload, const bool isSet) {
+  uint32_t id = 0;
+  bool ok = !id_text.empty() && id_text.size() <= 8;
+  for (const char c : id_text) {
+    const int digit = hexDigit(c);
+    ok &= digit >= 0;
+    id = ok ? id << 4 | static_cast<uint32_t>(digit) : 0;
+  }
+  if (ok && isSet) {
+    char* endPtr;
+    const unsigned long period_ms = strtoul(payload, &endPtr, 10);
+    unsigned long phase_ms = ~0UL;
+    if (*endPtr == ',') {
+      phase_ms = strtoul(endPtr + 1, &endPtr, 10);
+    }
+    ok = *endPtr == '\0' && battery.can.configureSchedule(id, period_ms, phase_ms);
+  } else if (ok) {
+    ok = battery.can.resetSchedule(id);
+  }
+  char line[96];
+  snprintf(line, sizeof(line), "schedule %03lx %s: %s", static_cast<unsigned long>(id), isSet ? payload : "reset",
+           ok ? "ok" : "rejected");
+  log(line);
+}
+
+void MqttManager::log(const char* line, const bool async, const int priority) {
+  if (log_topic == invalid_topic) {
+    publish("log", line, false, async, priority);  // before init()
   } else {
-    *it->second.valuePtr = it->second.defaultValue;
+    publish(log_topic, line, false, async, priority);
   }
 }
 
-void MqttManager::log(const String& line, const bool async, const int priority) {
-  publish("log", line, false, async, priority);
+void MqttManager::publish(const char* topic, const float value, const bool retain, const bool async,
+                          const int priority) {
+  char payload[16];
+  formatFixed(toScaled(value, 2), 2, payload, sizeof(payload));
+  publish(topic, payload, retain, async, priority);
 }
 
-void MqttManager::publish(const String& topic, const float value, const bool retain, const bool async,
+void MqttManager::publish(const char* topic, const uint32_t value, const bool retain, const bool async,
                           const int priority) {
-  publish(topic, String(value), retain, async, priority);
+  char payload[12];
+  snprintf(payload, sizeof(payload), "%lu", static_cast<unsigned long>(value));
+  publish(topic, payload, retain, async, priority);
 }
 
-void MqttManager::publish(const String& topic, const uint32_t value, const bool retain, const bool async,
+void MqttManager::publish(const char* topic, const char* payload, const bool retain, const bool async,
                           const int priority) {
-  publish(topic, String(value), retain, async, priority);
+  if (async) {
+    const uint32_t oversized = messageQueue.oversized;
+    messageQueue.push(module_topic.c_str(), topic, payload, retain, priority);
+    queued(topic, payload, oversized);
+  } else {
+    char full_topic[max_mqtt_topic_length];
+    snprintf(full_topic, sizeof(full_topic), "%s%s", module_topic.c_str(), topic);
+    hal.mqtt->publish(full_topic, payload, retain);
+  }
 }
 
-void MqttManager::publish(const String& topic, const String& payload, const bool retain, const bool async,
+void MqttManager::publish(const TopicHandle topic, const float value, const bool retain, const bool async,
+                          const int priority) {
+  char payload[16];
+  formatFixed(toScaled(value, 2), 2, payload, sizeof(payload));
+  publish(topic, payload, retain, async, priority);
+}
+
+void MqttManager::publish(const TopicHandle topic, const uint32_t value, const bool retain, const bool async,
+                          const int priority) {
+  char payload[12];
+  snprintf(payload, sizeof(payload), "%lu", static_cast<unsigned long>(value));
+  publish(topic, payload, retain, async, priority);
+}
+
+void MqttManager::publish(const TopicHandle topic, const char* payload, const bool retain, const bool async,
+                          const int priority) {
+  if (topic >= topic_count) {
+    return;
+  }
+  enqueue(topic_table[topic], payload, retain, async, priority);
+}
+
+void MqttManager::enqueue(const char* full_topic, const char* payload, const bool retain, const bool async,
                           const int priority) {
   if (async) {
-    const QueuedMessage msg{module_topic + topic, payload, retain, priority};
-    if (messageQueue.size() >= max_mqtt_send_queue) {
-      if (const auto it = --messageQueue.end(); priority > it->priority) {
-        messageQueue.erase(it);  // delete lowest priority message
-        messageQueue.insert(msg);
-      }
-    } else {
-      messageQueue.insert(msg);
-    }
+    const uint32_t oversized = messageQueue.oversized;
+    messageQueue.push(full_topic, payload, retain, priority);
+    queued(full_topic, payload, oversized);
   } else {
-    client.publish((module_topic + topic).c_str(), 0, retain, payload.c_str(), 0, false);
+    hal.mqtt->publish(full_topic, payload, retain);
+  }
+}
+
+void MqttManager::queued(const char* topic, const char* payload, const uint32_t oversized_before) {
+  if (messageQueue.size() > queue_stats.depth_high_water) {
+    queue_stats.depth_high_water = messageQueue.size();
+  }
+  if (messageQueue.oversized != oversized_before) {
+    // serial only, logging it over mqtt could be just as long
+    hal.log->printf("mqtt %s: %u byte payload does not fit a queue slot, dropped\n", topic,
+                    static_cast<unsigned int>(strlen(payload)));
   }
 }
 
-void MqttManager::subscribe(const String& topic) { client.subscribe((module_topic + topic).c_str(), 0); }
+void MqttManager::subscribe(const char* topic) {
+  char full_topic[max_mqtt_topic_length];
+  snprintf(full_topic, sizeof(full_topic), "%s%s", module_topic.c_str(), topic);
+  hal.mqtt->subscribe(full_topic);
+}
 
 void MqttManager::publishInfos() {
   // publish("version", VERSION, true);
   // publish("build_timestamp", BUILD_TIMESTAMP, true);
-  publish("wifi", WiFi.SSID(), true, true, 20);
-  publish("ip", WiFi.localIP().toString(), true, true, 40);
-  publish("esp_sdk", ESP.getSdkVersion(), true, true, 20);
-  publish("cpu",
-          String(ESP.getChipModel()) + " rev " + ESP.getChipRevision() + " " + ESP.getChipCores() + "x" +
-              ESP.getCpuFreqMHz() + "MHz",
-          true, true, 20);
-  publish("flash", String(ESP.getFlashChipSize() / 1024 / 1024) + " MiB, Mode: " + ESP.getFlashChipMode(), true, true,
-          20);
-  publish("heap", String(ESP.getHeapSize() / 1024) + " KiB", true, true, 20);
-  publish("psram", String(ESP.getPsramSize() / 1024) + " KiB", true, true, 20);
+  BoardInfo info{};
+  hal.board->getInfo(info);
+  publish("wifi", info.wifi, true, true, 20);
+  publish("ip", info.ip, true, true, 40);
+  publish("esp_sdk", info.sdk, true, true, 20);
+  publish("cpu", info.cpu, true, true, 20);
+  publish("flash", info.flash, true, true, 20);
+  publish("heap", info.heap, true, true, 20);
+  publish("psram", info.psram, true, true, 20);
   // publish("build_time", unixToTime(CURRENT_TIME), true);
 }
 
-void MqttManager::onConnect(bool session_present) {
-  Serial.println("connected");
+// boot/<stage>_ms for every stage reached so far, 0.1 ms resolution, retained so the last boot stays visible
+void MqttManager::publishBootTimeline() {
+  for (uint8_t stage = 0; stage < BootTimeline::stage_count; stage++) {
+    const auto boot_stage = static_cast<BootTimeline::Stage>(stage);
+    if (!battery.boot.reached(boot_stage)) {
+      continue;
+    }
+    char topic[32];
+    char payload[16];
+    snprintf(topic, sizeof(topic), "boot/%s_ms", BootTimeline::name(boot_stage));
+    formatFixed(static_cast<int32_t>(battery.boot.at(boot_stage) / 100), 1, payload, sizeof(payload));
+    publish(topic, payload, true, true, 20);
+  }
+}
+
+void MqttManager::onConnect() {
+  hal.log->println("connected");
+  battery.boot.mark(BootTimeline::mqtt_connected, connected_us);
+  battery.telemetry.invalidate();  // fresh session, send the full value set again
   publish("available", "online", true, true, 100);
-  publish("hostname", MainVars::hostname, true, true, 20);
-  publish("module_topic", module_topic, true, true, 20);
+  publishBootTimeline();
+  publish("hostname", hal.board->hostname(), true, true, 20);
+  publish("module_topic", module_topic.c_str(), true, true, 20);
   publishInfos();
-  client.subscribe(mqtt_master_heartbeat_topic, 0);
+  hal.mqtt->subscribe(mqtt_master_heartbeat_topic);
   subscribe("+/+/set");
   subscribe("+/+/reset");
   subscribe("restart");
   // subscribe("debug");
   subscribe("blink");
+  subscribe("trace");
   subscribe("ota");
 }
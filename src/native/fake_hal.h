@@ -0,0 +1,156 @@
+#pragma once
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hal.h"
+
+// in-process backends for the native env, time only advances when the simulation says so
+
+class FakeClock final : public Clock {
+ public:
+  unsigned long millis() override { return static_cast<unsigned long>(now_us / 1000ULL); }
+  unsigned long micros() override { return static_cast<unsigned long>(now_us); }
+  void advanceMicros(const uint64_t us) { now_us += us; }
+  void advanceMillis(const uint64_t ms) { now_us += ms * 1000ULL; }
+
+  uint64_t now_us = 0;
+};
+
+class FakeCanDriver final : public CanDriver {
+ public:
+  bool begin(const CanFilter& filter) override;
+  bool transmit(const CanFrame& frame) override;
+  bool receive(CanFrame& frame) override;
+  uint32_t readAlerts(unsigned long timeout_ms) override;
+  void getStatus(CanStatus& status) override { status = this->status; }
+  void inject(const CanFrame& frame);  // frames the acceptance filter rejects never reach rx, like on silicon
+
+  bool started = false;
+  bool keep_tx = false;  // collect transmitted frames in tx, otherwise only count them
+  bool no_ack = false;   // every attempt fails like on a bus without any other node
+  uint64_t tx_count = 0;
+  uint64_t filtered_count = 0;
+  CanFilter filter{0, 0xFFFFFFFF, true};
+  uint32_t pending_alerts = 0;
+  CanStatus status{};
+  std::deque<CanFrame> rx;
+  std::vector<CanFrame> tx;
+};
+
+class FakeMqttClient final : public MqttClient {
+ public:
+  struct Message {
+    std::string topic;
+    std::string payload;
+    bool retain;
+  };
+
+  void begin(const char* server, const char* user, const char* password, const char* will_topic,
+             ConnectCallback on_connect, MessageCallback on_message) override;
+  bool connected() override { return is_connected; }
+  void publish(const char* topic, const char* payload, bool retain) override;
+  void subscribe(const char* topic) override { subscriptions.emplace_back(topic); }
+  void deliver(const char* topic, const char* payload);
+
+  bool is_connected = false;
+  bool keep_published = false;  // collect published messages in published, otherwise only count them
+  uint64_t publish_count = 0;
+  std::vector<Message> published;
+  std::vector<std::string> subscriptions;
+
+ private:
+  ConnectCallback on_connect;
+  MessageCallback on_message;
+};
+
+class FakeLogger final : public Logger {
+ public:
+  void write(const char* text) override;
+
+  bool echo = false;  // mirror log output to stdout
+  uint64_t bytes_written = 0;
+};
+
+class FakeBoard final : public Board {
+ public:
+  void restart() override { restarts++; }
+  void setLed(const bool on) override {
+    led_changes += led != on;
+    led = on;
+  }
+  const char* hostname() override { return name.c_str(); }
+  void getInfo(BoardInfo& info) override;
+  void getMemory(MemoryInfo& memory) override { memory = this->memory; }
+  uint32_t stackFree() override { return 0; }
+  bool startTask(void (*)(void*), const char*, uint32_t, uint8_t, void*) override { return false; }  // poll
+
+  std::string name = "espcan-native";
+  bool led = false;
+  unsigned int led_changes = 0;
+  unsigned int restarts = 0;
+  MemoryInfo memory{};
+};
+
+class FakeStorage final : public Storage {
+ public:
+  bool load(const char* key, void* data, size_t size) override;
+  bool save(const char* key, const void* data, size_t size) override;
+
+  bool fail = false;   // every save fails, like a full or worn out partition
+  uint64_t saves = 0;  // flash writes the firmware would have done
+  std::map<std::string, std::vector<uint8_t>> blobs;
+};
+
+// update server and flash in one: serves a generated image of image_size bytes, bytes_per_ms of it arrive per
+// simulated millisecond, and every written byte is checked against the pattern so a lost or repeated chunk fails the
+// update like a bad image checksum would
+class FakeUpdater final : public Updater {
+ public:
+  explicit FakeUpdater(Clock& clock) : clock(clock) {}
+
+  bool begin(const char* path, uint32_t& size, char* message, size_t message_size) override;
+  int read(uint8_t* buffer, size_t size) override;
+  bool write(const uint8_t* buffer, size_t size) override;
+  bool end(bool commit, char* message, size_t message_size) override;
+  static uint8_t imageByte(const uint32_t offset) { return static_cast<uint8_t>(offset * 31U ^ offset >> 8); }
+
+  uint32_t image_size = 0;  // 0 = nothing to update to
+  unsigned long bytes_per_ms = 256;
+  uint32_t drop_at = 0;  // connection lost after this many bytes, 0 = never
+  unsigned int installs = 0;
+
+ private:
+  Clock& clock;
+  unsigned long last_ms = 0;
+  uint64_t credit = 0;  // bytes that arrived and were not read yet
+  uint32_t served = 0;
+  uint32_t written = 0;
+  bool intact = true;
+};
+
+extern FakeClock fake_clock;
+extern FakeCanDriver fake_can;
+extern FakeMqttClient fake_mqtt;
+extern FakeLogger fake_logger;
+extern FakeBoard fake_board;
+extern FakeStorage fake_storage;
+extern FakeUpdater fake_updater;
+
+// backends of one battery in a simulated fleet: own bus and broker session per node, the clock is shared
+struct FakeNode {
+  explicit FakeNode(Clock& clock = fake_clock)
+      : updater(clock), hal{&clock, &can, &mqtt, &log, &board, &storage, &updater} {}
+  FakeNode(const FakeNode&) = delete;
+  FakeNode& operator=(const FakeNode&) = delete;
+
+  FakeCanDriver can;
+  FakeMqttClient mqtt;
+  FakeLogger log;
+  FakeBoard board;
+  FakeStorage storage;
+  FakeUpdater updater;
+  Hal hal;
+};
@@ -0,0 +1,171 @@
+#include <cstdio>
+#include <cstring>
+
+#include "can_dispatch.h"
+#include "fake_hal.h"
+
+bool FakeCanDriver::begin(const CanFilter& filter) {
+  this->filter = filter;
+  return started = true;
+}
+
+void FakeCanDriver::inject(const CanFrame& frame) {
+  if (!canFilterAccepts(filter, frame)) {
+    filtered_count++;
+    return;
+  }
+  rx.push_back(frame);
+  std::memset(rx.back().data + frame.len, 0, sizeof(frame.data) - frame.len);
+}
+
+bool FakeCanDriver::transmit(const CanFrame& frame) {
+  if (!started) {
+    return false;
+  }
+  if (no_ack) {
+    pending_alerts |= CAN_ALERT_TX_FAILED;
+    return true;
+  }
+  pending_alerts |= CAN_ALERT_TX_SUCCESS;
+  tx_count++;
+  if (keep_tx) {
+    tx.push_back(frame);
+  }
+  return true;
+}
+
+bool FakeCanDriver::receive(CanFrame& frame) {
+  if (rx.empty()) {
+    return false;
+  }
+  frame = rx.front();
+  rx.pop_front();
+  return true;
+}
+
+uint32_t FakeCanDriver::readAlerts(unsigned long /*timeout_ms*/) {
+  uint32_t alerts = pending_alerts;
+  pending_alerts = 0;
+  if (!rx.empty()) {
+    alerts |= CAN_ALERT_RX_DATA;
+  }
+  return alerts;
+}
+
+void FakeMqttClient::begin(const char* /*server*/, const char* /*user*/, const char* /*password*/,
+                           const char* /*will_topic*/, ConnectCallback on_connect, MessageCallback on_message) {
+  this->on_connect = std::move(on_connect);
+  this->on_message = std::move(on_message);
+  is_connected = true;
+  this->on_connect(false);
+}
+
+void FakeMqttClient::publish(const char* topic, const char* payload, const bool retain) {
+  publish_count++;
+  if (keep_published) {
+    published.push_back({topic, payload, retain});
+  }
+}
+
+void FakeMqttClient::deliver(const char* topic, const char* payload) {
+  if (!on_message) {
+    return;
+  }
+  // the real client hands out mutable buffers, mirror that
+  std::string topic_copy(topic);
+  std::string payload_copy(payload);
+  on_message(topic_copy.data(), payload_copy.data(), 0, 0, false);
+}
+
+void FakeLogger::write(const char* text) {
+  bytes_written += strlen(text);
+  if (echo) {
+    fputs(text, stdout);
+  }
+}
+
+void FakeBoard::getInfo(BoardInfo& info) {
+  snprintf(info.wifi, sizeof(info.wifi), "native");
+  snprintf(info.ip, sizeof(info.ip), "127.0.0.1");
+  snprintf(info.sdk, sizeof(info.sdk), "native");
+  snprintf(info.cpu, sizeof(info.cpu), "host");
+  snprintf(info.flash, sizeof(info.flash), "0 MiB");
+  snprintf(info.heap, sizeof(info.heap), "0 KiB");
+  snprintf(info.psram, sizeof(info.psram), "0 KiB");
+}
+
+bool FakeStorage::load(const char* key, void* data, const size_t size) {
+  const auto blob = blobs.find(key);
+  if (blob == blobs.end() || blob->second.size() != size) {
+    return false;
+  }
+  std::memcpy(data, blob->second.data(), size);
+  return true;
+}
+
+bool FakeStorage::save(const char* key, const void* data, const size_t size) {
+  if (fail) {
+    return false;
+  }
+  const auto* bytes = static_cast<const uint8_t*>(data);
+  blobs[key].assign(bytes, bytes + size);
+  saves++;
+  return true;
+}
+
+bool FakeUpdater::begin(const char* path, uint32_t& size, char* message, const size_t message_size) {
+  if (image_size == 0) {
+    snprintf(message, message_size, "ota http 404 for %s", path);
+    return false;
+  }
+  size = image_size;
+  last_ms = clock.millis();
+  credit = served = written = 0;
+  intact = true;
+  return true;
+}
+
+int FakeUpdater::read(uint8_t* buffer, const size_t size) {
+  const unsigned long now = clock.millis();
+  credit += static_cast<uint64_t>(now - last_ms) * bytes_per_ms;
+  last_ms = now;
+  if (drop_at && served >= drop_at) {
+    return -1;
+  }
+  uint64_t n = credit < size ? credit : size;
+  n = n < image_size - served ? n : image_size - served;
+  for (uint64_t i = 0; i < n; i++) {
+    buffer[i] = imageByte(served + i);
+  }
+  credit -= n;
+  served += n;
+  return static_cast<int>(n);
+}
+
+bool FakeUpdater::write(const uint8_t* buffer, const size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    intact &= buffer[i] == imageByte(written + i);
+  }
+  written += size;
+  return true;
+}
+
+bool FakeUpdater::end(const bool commit, char* message, const size_t message_size) {
+  if (!commit) {
+    return false;
+  }
+  const bool ok = intact && written == image_size;
+  installs += ok;
+  snprintf(message, message_size, "ota %s", ok ? "ok" : "image check failed");
+  return ok;
+}
+
+FakeClock fake_clock;
+FakeCanDriver fake_can;
+FakeMqttClient fake_mqtt;
+FakeLogger fake_logger;
+FakeBoard fake_board;
+FakeStorage fake_storage;
+FakeUpdater fake_updater(fake_clock);
+
+Hal hal = {&fake_clock, &fake_can, &fake_mqtt, &fake_logger, &fake_board, &fake_storage, &fake_updater};
@@ -0,0 +1,119 @@
+#ifdef __linux__
+
+#include "http_updater.h"
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include "main_vars.h"
+
+HttpUpdater::HttpUpdater(const char* server, const char* output) : output(output) {
+  const char* colon = strrchr(server, ':');
+  host = colon ? std::string(server, colon) : server;
+  port = colon ? colon + 1 : "80";
+}
+
+HttpUpdater::~HttpUpdater() { disconnect(); }
+
+void HttpUpdater::disconnect() {
+  if (fd >= 0) {
+    close(fd);
+    fd = -1;
+  }
+  if (file) {
+    fclose(file);
+    file = nullptr;
+  }
+}
+
+bool HttpUpdater::begin(const char* path, uint32_t& size, char* message, const size_t message_size) {
+  disconnect();
+  addrinfo hints{};
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* address = nullptr;
+  if (getaddrinfo(host.c_str(), port.c_str(), &hints, &address) != 0) {
+    snprintf(message, message_size, "ota cannot resolve %s", host.c_str());
+    return false;
+  }
+  fd = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+  const bool connected = fd >= 0 && connect(fd, address->ai_addr, address->ai_addrlen) == 0;
+  freeaddrinfo(address);
+  if (!connected) {
+    snprintf(message, message_size, "ota connect failed: %s", strerror(errno));
+    disconnect();
+    return false;
+  }
+  // the headers are read blocking (with the stall timeout), only the body is streamed
+  const timeval timeout{static_cast<time_t>(ota_stall_timeout_ms / 1000UL), 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  const std::string request = "GET " + std::string(path) + " HTTP/1.0\r\nHost: " + host + "\r\n\r\n";
+  std::string response;
+  size_t header_end = std::string::npos;
+  char buffer[1024];
+  if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+    while ((header_end = response.find("\r\n\r\n")) == std::string::npos && response.size() < 16384) {
+      const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+      if (n <= 0) {
+        break;
+      }
+      response.append(buffer, n);
+    }
+  }
+  const int status = response.size() > 12 ? atoi(response.c_str() + 9) : 0;  // "HTTP/1.x 200 OK"
+  const size_t length_at = response.find("Content-Length:");
+  const long length = length_at < header_end ? atol(response.c_str() + length_at + 15) : 0;
+  if (header_end == std::string::npos || status != 200 || length <= 0) {
+    snprintf(message, message_size, "ota http %d, size %ld", status, length);
+    disconnect();
+    return false;
+  }
+  file = fopen(output, "wb");
+  if (!file) {
+    snprintf(message, message_size, "ota cannot write %s", output);
+    disconnect();
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  early_body = response.substr(header_end + 4);
+  this->size = size = static_cast<uint32_t>(length);
+  written = 0;
+  return true;
+}
+
+int HttpUpdater::read(uint8_t* buffer, const size_t size) {
+  if (!early_body.empty()) {
+    const size_t n = early_body.size() < size ? early_body.size() : size;
+    memcpy(buffer, early_body.data(), n);
+    early_body.erase(0, n);
+    return static_cast<int>(n);
+  }
+  const ssize_t n = recv(fd, buffer, size, 0);
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    return 0;
+  }
+  return n > 0 ? static_cast<int>(n) : -1;  // 0 from recv is the server closing early
+}
+
+bool HttpUpdater::write(const uint8_t* buffer, const size_t size) {
+  written += size;
+  return fwrite(buffer, 1, size, file) == size;
+}
+
+bool HttpUpdater::end(const bool commit, char* message, const size_t message_size) {
+  disconnect();
+  if (!commit) {
+    remove(output);
+    return false;
+  }
+  const bool ok = written == size;
+  snprintf(message, message_size, "ota %s, image in %s", ok ? "ok" : "short image", output);
+  return ok;
+}
+
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstdio>
+#include <string>
+
+#include "hal.h"
+
+// ota against a local http file server stand-in (e.g. python3 -m http.server in a directory holding a dummy image):
+// plain GET, the socket is non-blocking after the headers so read() returns whatever arrived, "flash" is a host file
+class HttpUpdater final : public Updater {
+ public:
+  HttpUpdater(const char* server, const char* output);  // server as host:port
+  HttpUpdater(const HttpUpdater&) = delete;
+  HttpUpdater& operator=(const HttpUpdater&) = delete;
+  ~HttpUpdater() override;
+
+  bool begin(const char* path, uint32_t& size, char* message, size_t message_size) override;
+  int read(uint8_t* buffer, size_t size) override;
+  bool write(const uint8_t* buffer, size_t size) override;
+  bool end(bool commit, char* message, size_t message_size) override;
+
+ private:
+  std::string host;
+  std::string port;
+  const char* output;
+  int fd = -1;
+  FILE* file = nullptr;
+  uint32_t size = 0;
+  uint32_t written = 0;
+  std::string early_body;  // image bytes that came in with the headers
+  void disconnect();
+};
+
+#endif
@@ -0,0 +1,421 @@
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "battery.h"
+#include "fake_hal.h"
+#include "fixed_point.h"
+#include "http_updater.h"
+#include "replay.h"
+#include "socket_can.h"
+
+#ifndef PIO_UNIT_TESTING  // pio test links src into every test, each test brings its own main
+
+// host simulator: runs the firmware core against the fake backends under simulated time
+// usage: program [simulated_seconds] [loop_step_us]
+//        program --replay capture.log   (candump -L, e.g. from the candump mqtt topic or a field sniffer)
+//        program --instances count [simulated_seconds] [loop_step_us]   (fleet, one fake bus and broker each)
+//        program --vcan prefix count [seconds]   (real time, battery i on interface <prefix><i>, linux only)
+//        program --ota-http host:port path [seconds]   (real time ota from a local http server, linux only)
+
+static CanFrame inverterFrame(const uint32_t id, const uint16_t a, const uint16_t b, const uint16_t c) {
+  CanFrame frame{};
+  frame.id = id;
+  frame.len = 8;
+  frame.data[0] = a >> 8;
+  frame.data[1] = a;
+  frame.data[2] = b >> 8;
+  frame.data[3] = b;
+  frame.data[4] = c >> 8;
+  frame.data[5] = c;
+  return frame;
+}
+
+static int replay(const char* path) {
+  std::vector<ReplayFrame> frames;
+  ReplayStats stats{};
+  if (!loadCapture(path, frames, stats)) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return 1;
+  }
+  fake_can.keep_tx = true;
+  static Battery battery(hal);
+  battery.begin();
+  battery.connect();
+  const auto start = std::chrono::steady_clock::now();
+  replayCapture(battery, frames);
+  const auto elapsed_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+  printf("lines:          %llu (malformed %llu, tx skipped %llu)\n", static_cast<unsigned long long>(stats.lines),
+         static_cast<unsigned long long>(stats.malformed), static_cast<unsigned long long>(stats.skipped_tx));
+  printf("frames:         %llu\n", static_cast<unsigned long long>(stats.frames));
+  printf("simulated:      %.3f s\n", static_cast<double>(fake_clock.now_us) / 1e6);
+  printf("wall time:      %.3f ms\n", static_cast<double>(elapsed_ns) / 1e6);
+  printf("frames per s:   %.0f\n", elapsed_ns ? static_cast<double>(stats.frames) * 1e9 / elapsed_ns : 0.0);
+  printf("can tx frames:  %llu\n", static_cast<unsigned long long>(fake_can.tx_count));
+  printf("mqtt publishes: %llu\n", static_cast<unsigned long long>(fake_mqtt.publish_count));
+  return 0;
+}
+
+static void injectInverter(FakeCanDriver& can, const unsigned long now) {
+  can.inject(inverterFrame(0x91, 2150, 43, 220));
+  can.inject(inverterFrame(0xd1, 287, 0, 0));
+  if (now % 10000UL == 0) {
+    can.inject(inverterFrame(0x111, static_cast<uint16_t>(now >> 16), static_cast<uint16_t>(now), 0));
+  }
+}
+
+// longest silence between two 0x110 frames while an update runs, the limits are what the inverter times out on
+struct LimitsGap {
+  unsigned long last_ms = 0;
+  unsigned long max_ms = 0;
+
+  void watch(FakeCanDriver& can, const unsigned long now, const bool ota_running) {
+    for (const CanFrame& frame : can.tx) {
+      if (frame.id == 0x110) {
+        if (ota_running && last_ms && now - last_ms > max_ms) {
+          max_ms = now - last_ms;
+        }
+        last_ms = now;
+      }
+    }
+    can.tx.clear();
+  }
+};
+
+// resident set size, 0 where /proc is not available
+static unsigned long residentBytes() {
+  unsigned long pages = 0, resident = 0;
+  FILE* file = fopen("/proc/self/statm", "r");
+  if (file == nullptr) {
+    return 0;
+  }
+  if (fscanf(file, "%lu %lu", &pages, &resident) != 2) {
+    resident = 0;
+  }
+  fclose(file);
+  return resident * static_cast<unsigned long>(sysconf(_SC_PAGESIZE));
+}
+
+static double cpuSeconds() { return static_cast<double>(clock()) / CLOCKS_PER_SEC; }
+
+static void printFleetCost(const size_t count, const uint64_t loops, const double cpu_s, const unsigned long rss) {
+  printf("instances:      %zu\n", count);
+  printf("loop calls:     %llu per instance\n", static_cast<unsigned long long>(loops));
+  printf("cpu time:       %.3f s\n", cpu_s);
+  printf("ns per loop:    %.1f per instance\n", loops ? cpu_s * 1e9 / static_cast<double>(loops * count) : 0.0);
+  printf("battery size:   %zu bytes (+%zu fake backends)\n", sizeof(Battery), sizeof(FakeNode));
+  printf("rss growth:     %lu bytes per instance\n", count ? rss / count : 0);
+}
+
+// many batteries in one process, each with its own fake bus and broker session under the shared simulated clock
+static int fleet(const size_t count, const unsigned long simulated_s, const unsigned long step_us) {
+  std::vector<std::unique_ptr<FakeNode>> nodes;
+  std::vector<std::unique_ptr<Battery>> batteries;
+  const unsigned long rss_before = residentBytes();
+  for (size_t i = 0; i < count; i++) {
+    nodes.push_back(std::make_unique<FakeNode>());
+    nodes.back()->board.name = "espcan-sim-" + std::to_string(i);
+    const std::string module_topic = "sim/" + std::to_string(i) + "/";
+    batteries.push_back(std::make_unique<Battery>(nodes.back()->hal, module_topic.c_str()));
+    batteries.back()->begin();
+    batteries.back()->connect();
+  }
+  const unsigned long rss = residentBytes() - rss_before;
+
+  uint64_t loops = 0;
+  unsigned long next_inverter_ms = 0;
+  unsigned long next_heartbeat_ms = 0;
+  const double cpu_start = cpuSeconds();
+  while (fake_clock.millis() < simulated_s * 1000UL) {
+    const unsigned long now = fake_clock.millis();
+    const bool inverter = now >= next_inverter_ms;
+    const bool heartbeat = now >= next_heartbeat_ms;
+    next_inverter_ms += inverter ? 1000UL : 0;
+    next_heartbeat_ms += heartbeat ? 30UL * 1000UL : 0;
+    for (size_t i = 0; i < count; i++) {
+      if (inverter) {
+        injectInverter(nodes[i]->can, now);
+      }
+      if (heartbeat) {
+        nodes[i]->mqtt.deliver("master/uptime", "1");
+      }
+      batteries[i]->loop();
+    }
+    loops++;
+    fake_clock.advanceMicros(step_us);
+  }
+  const double cpu_s = cpuSeconds() - cpu_start;
+
+  uint64_t tx = 0, published = 0;
+  unsigned int restarts = 0;
+  for (const auto& node : nodes) {
+    tx += node->can.tx_count;
+    published += node->mqtt.publish_count;
+    restarts += node->board.restarts;
+  }
+  printf("simulated:      %lu s\n", simulated_s);
+  printFleetCost(count, loops, cpu_s, rss);
+  printf("can tx frames:  %llu\n", static_cast<unsigned long long>(tx));
+  printf("mqtt publishes: %llu\n", static_cast<unsigned long long>(published));
+  printf("restarts:       %u\n", restarts);
+  return 0;
+}
+
+#ifdef __linux__
+// the same fleet on real SocketCAN interfaces in real time, the inverter side is whatever talks on those buses
+static int vcan(const char* prefix, const size_t count, const unsigned long seconds) {
+  static HostClock host_clock;
+  std::vector<std::unique_ptr<SocketCanDriver>> drivers;
+  std::vector<std::unique_ptr<FakeNode>> nodes;
+  std::vector<std::unique_ptr<Battery>> batteries;
+  std::vector<std::string> interfaces;
+  interfaces.reserve(count);
+  const unsigned long rss_before = residentBytes();
+  for (size_t i = 0; i < count; i++) {
+    interfaces.push_back(prefix + std::to_string(i));
+    drivers.push_back(std::make_unique<SocketCanDriver>(interfaces.back().c_str()));
+    nodes.push_back(std::make_unique<FakeNode>(host_clock));
+    nodes.back()->board.name = "espcan-" + interfaces.back();
+    nodes.back()->hal.can = drivers.back().get();
+    const std::string module_topic = "sim/" + interfaces.back() + "/";
+    batteries.push_back(std::make_unique<Battery>(nodes.back()->hal, module_topic.c_str()));
+    batteries.back()->begin();
+    batteries.back()->connect();
+  }
+  const unsigned long rss = residentBytes() - rss_before;
+
+  uint64_t loops = 0;
+  unsigned long next_heartbeat_ms = 0;
+  const double cpu_start = cpuSeconds();
+  while (host_clock.millis() < seconds * 1000UL) {
+    const bool heartbeat = host_clock.millis() >= next_heartbeat_ms;
+    next_heartbeat_ms += heartbeat ? 30UL * 1000UL : 0;
+    for (size_t i = 0; i < count; i++) {
+      if (heartbeat) {
+        nodes[i]->mqtt.deliver("master/uptime", "1");
+      }
+      batteries[i]->loop();
+    }
+    loops++;
+    usleep(1000);
+  }
+  const double cpu_s = cpuSeconds() - cpu_start;
+
+  uint64_t published = 0;
+  unsigned int restarts = 0;
+  for (const auto& node : nodes) {
+    published += node->mqtt.publish_count;
+    restarts += node->board.restarts;
+  }
+  printf("run time:       %lu s\n", seconds);
+  printFleetCost(count, loops, cpu_s, rss);
+  printf("mqtt publishes: %llu\n", static_cast<unsigned long long>(published));
+  printf("restarts:       %u\n", restarts);
+  return 0;
+}
+
+// one battery in real time fetching its update from a local http server while it keeps serving the simulated
+// inverter, the image ends up in ota.bin
+static int otaHttp(const char* server, const char* path, const unsigned long seconds) {
+  static HostClock host_clock;
+  FakeNode node(host_clock);
+  HttpUpdater updater(server, "ota.bin");
+  node.hal.updater = &updater;
+  node.log.echo = true;
+  node.can.keep_tx = true;
+  Battery battery(node.hal);
+  battery.begin();
+  battery.connect();
+
+  LimitsGap gap;
+  uint64_t loops = 0;
+  unsigned long next_inverter_ms = 0;
+  node.mqtt.deliver("master/can/ota", path);
+  while (battery.ota.state() != Ota::idle && host_clock.millis() < seconds * 1000UL) {
+    const unsigned long now = host_clock.millis();
+    if (now >= next_inverter_ms) {
+      next_inverter_ms += 1000UL;
+      injectInverter(node.can, now);
+    }
+    battery.loop();
+    gap.watch(node.can, now, true);
+    loops++;
+    usleep(100);
+  }
+  printf("loop calls:     %llu\n", static_cast<unsigned long long>(loops));
+  printf("ota:            %lu of %lu bytes, 0x110 max gap %lu ms\n", static_cast<unsigned long>(battery.ota.received()),
+         static_cast<unsigned long>(battery.ota.size()), gap.max_ms);
+  printf("restarts:       %u\n", node.board.restarts);
+  return node.board.restarts == 1 ? 0 : 1;
+}
+#endif
+
+int main(const int argc, char** argv) {
+  if (argc > 2 && strcmp(argv[1], "--replay") == 0) {
+    return replay(argv[2]);
+  }
+  if (argc > 2 && strcmp(argv[1], "--instances") == 0) {
+    return fleet(strtoul(argv[2], nullptr, 10), argc > 3 ? strtoul(argv[3], nullptr, 10) : 3600UL,
+                 argc > 4 ? strtoul(argv[4], nullptr, 10) : 1000UL);
+  }
+#ifdef __linux__
+  if (argc > 3 && strcmp(argv[1], "--vcan") == 0) {
+    return vcan(argv[2], strtoul(argv[3], nullptr, 10), argc > 4 ? strtoul(argv[4], nullptr, 10) : 60UL);
+  }
+  if (argc > 3 && strcmp(argv[1], "--ota-http") == 0) {
+    return otaHttp(argv[2], argv[3], argc > 4 ? strtoul(argv[4], nullptr, 10) : 300UL);
+  }
+#endif
+  const unsigned long simulated_s = argc > 1 ? strtoul(argv[1], nullptr, 10) : 3600UL;
+  const unsigned long step_us = argc > 2 ? strtoul(argv[2], nullptr, 10) : 1000UL;
+
+  static Battery battery(hal);
+  battery.begin();
+  battery.connect();
+
+  CanFrame init_request{};
+  init_request.id = 0x151;
+  init_request.len = 8;
+  init_request.data[0] = 0x01;
+  fake_can.inject(init_request);
+
+  // a 1.5 MiB update at 200 kB/s ten minutes in, polled one chunk per loop since the fake board has no tasks
+  fake_updater.image_size = 1536UL * 1024UL;
+  fake_updater.bytes_per_ms = 200;
+  fake_can.keep_tx = true;
+  LimitsGap ota_gap;
+  unsigned long ota_start_ms = 0, ota_ms = 0;
+  uint32_t storm_alerts = 0;
+
+  uint64_t loops = 0;
+  unsigned long next_inverter_ms = 0;
+  unsigned long next_heartbeat_ms = 0;
+  unsigned long next_derate_ms = 150UL * 1000UL + 500UL;  // off the 0x110 grid
+  const auto start = std::chrono::steady_clock::now();
+  while (fake_clock.millis() < simulated_s * 1000UL) {
+    const unsigned long now = fake_clock.millis();
+    if (now >= next_inverter_ms) {
+      next_inverter_ms += 1000UL;
+      injectInverter(fake_can, now);
+    }
+    if (now >= next_heartbeat_ms) {
+      next_heartbeat_ms += 30UL * 1000UL;
+      fake_mqtt.deliver("master/uptime", "1");
+    }
+    if (now >= next_derate_ms) {
+      next_derate_ms += 5UL * 60UL * 1000UL;  // master derating, goes out as an out of cycle 0x110
+      fake_mqtt.deliver("master/can/limits/max_charge_current/set", (now / 1000UL) % 600UL < 300UL ? "12.5" : "25.6");
+    }
+    if (now >= 1200UL * 1000UL && now < 1230UL * 1000UL) {
+      // bus error storm, every loop pass sees a fresh alert, the monitor turns it into one alarm and its clearing
+      fake_can.pending_alerts |= CAN_ALERT_BUS_ERROR;
+      fake_can.status.bus_error_count++;
+      storm_alerts++;
+    }
+    if (now >= 600UL * 1000UL && ota_start_ms == 0) {
+      ota_start_ms = now;
+      fake_mqtt.deliver("master/can/ota", "/firmware.bin");
+    }
+    battery.loop();
+    const bool ota_running = battery.ota.state() != Ota::idle;
+    ota_gap.watch(fake_can, now, ota_running);
+    if (ota_start_ms && !ota_running && ota_ms == 0) {
+      ota_ms = now - ota_start_ms;
+    }
+    loops++;
+    fake_clock.advanceMicros(step_us);
+  }
+  const auto elapsed = std::chrono::steady_clock::now() - start;
+  const auto elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+
+  // inbound command path: hand-over to the loop task, prefix strip, suffix match, topic lookup and value update
+  // (includes the fake's copies and an otherwise idle mqtt loop)
+  static const char* const commands[][2] = {
+      {"master/can/limits/max_charge_current/set", "12.5"}, {"master/can/battery/soc/set", "55"},
+      {"master/can/battery/temp/reset", ""},                {"master/can/inverter/soc/set", "1"},
+      {"master/can/unknown/value/set", "1"},
+  };
+  constexpr unsigned long command_count = 100000UL;
+  const auto command_start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < command_count; i++) {
+    const auto& command = commands[i % (sizeof(commands) / sizeof(commands[0]))];
+    fake_mqtt.deliver(command[0], command[1]);
+    battery.mqtt.loop();
+  }
+  const auto command_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                               command_start).count();
+
+  // unknown traffic: 40 ids no handler claims, straight into the rx path (the trace ring simply fills up)
+  constexpr unsigned long unknown_count = 1000000UL;
+  CanFrame unknown = inverterFrame(0x400, 1, 2, 3);
+  const auto unknown_start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < unknown_count; i++) {
+    unknown.id = 0x400 + i % 40;
+    unknown.data[7] = static_cast<uint8_t>(i);
+    battery.can.readMessage(unknown);
+  }
+  const auto unknown_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                               unknown_start).count();
+
+  // payload formatting: fixed point against the printf float path it replaced, checksums keep the loops alive
+  constexpr unsigned long format_count = 1000000UL;
+  char payload[24];
+  unsigned long checksum = 0;
+  const auto fixed_start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < format_count; i++) {
+    const float value = static_cast<float>(i % 4000) * 0.1f - 100.f;
+    checksum += formatFixed(toScaled(value, 1), 1, payload, sizeof(payload));
+  }
+  const auto printf_start = std::chrono::steady_clock::now();
+  for (unsigned long i = 0; i < format_count; i++) {
+    const float value = static_cast<float>(i % 4000) * 0.1f - 100.f;
+    checksum += snprintf(payload, sizeof(payload), "%.1f", static_cast<double>(value));
+  }
+  const auto format_end = std::chrono::steady_clock::now();
+  const auto fixed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(printf_start - fixed_start).count();
+  const auto printf_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(format_end - printf_start).count();
+
+  printf("simulated:      %lu s\n", simulated_s);
+  printf("loop calls:     %llu\n", static_cast<unsigned long long>(loops));
+  printf("wall time:      %.3f ms\n", static_cast<double>(elapsed_ns) / 1e6);
+  printf("ns per loop:    %.1f\n", loops ? static_cast<double>(elapsed_ns) / static_cast<double>(loops) : 0.0);
+  printf("can tx frames:  %llu\n", static_cast<unsigned long long>(fake_can.tx_count));
+  printf("mqtt publishes: %llu\n", static_cast<unsigned long long>(fake_mqtt.publish_count));
+  printf("queue max:      %u (drain calls %lu)\n", battery.mqtt.queue_stats.depth_high_water,
+         static_cast<unsigned long>(battery.mqtt.queue_stats.drain_calls));
+  printf("suppressed:     %lu of %lu\n", static_cast<unsigned long>(battery.telemetry.stats.suppressed),
+         static_cast<unsigned long>(battery.telemetry.stats.offered));
+  const CanTxStats& tx = battery.bus.txStats();
+  printf("tx latency:     avg %lu us, max %lu us, dropped %lu, %lu after %u attempts\n",
+         static_cast<unsigned long>(tx.avg_latency_us), static_cast<unsigned long>(tx.max_latency_us),
+         static_cast<unsigned long>(tx.dropped_stale + tx.dropped_full),
+         static_cast<unsigned long>(tx.dropped_attempts), static_cast<unsigned int>(can_tx_max_attempts));
+  printf("urgent tx:      %lu, latency avg %lu us, max %lu us\n", static_cast<unsigned long>(tx.urgent_sent),
+         static_cast<unsigned long>(tx.urgent_latency_avg_us), static_cast<unsigned long>(tx.urgent_latency_max_us));
+  printf("first can tx:   %lu us after boot\n", battery.boot.at(BootTimeline::first_can_tx));
+  printf("ota:            %lu bytes in %lu ms, 0x110 max gap %lu ms, installs %u\n",
+         static_cast<unsigned long>(battery.ota.received()), ota_ms, ota_gap.max_ms, fake_updater.installs);
+  char load[12];
+  formatFixed(battery.monitor.load_hundredths, 2, load, sizeof(load));
+  printf("bus:            load %s %%, %lu error alerts, %lu alarms raised\n", load,
+         static_cast<unsigned long>(storm_alerts), static_cast<unsigned long>(battery.monitor.alarms_raised));
+  printf("log bytes:      %llu\n", static_cast<unsigned long long>(fake_logger.bytes_written));
+  printf("restarts:       %u\n", fake_board.restarts);
+  printf("ns per command: %.1f\n", static_cast<double>(command_ns) / command_count);
+  printf("ns per unknown: %.1f (%lu ids tracked, %lu overflowed)\n", static_cast<double>(unknown_ns) / unknown_count,
+         static_cast<unsigned long>(battery.unknown.ids()), static_cast<unsigned long>(battery.unknown.overflow));
+  printf("ns per format:  fixed %.1f, printf %.1f (%lu)\n", static_cast<double>(fixed_ns) / format_count,
+         static_cast<double>(printf_ns) / format_count, checksum);
+  return 0;
+}
+
+#endif  // PIO_UNIT_TESTING
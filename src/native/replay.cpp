@@ -0,0 +1,77 @@
+#include "replay.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "can_trace.h"
+#include "fake_hal.h"
+
+bool loadCapture(const char* path, std::vector<ReplayFrame>& frames, ReplayStats& stats) {
+  FILE* file = fopen(path, "r");
+  if (file == nullptr) {
+    return false;
+  }
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    stats.lines++;
+    char interface[32];
+    char frame_text[64];
+    unsigned long seconds;
+    char fraction[16];
+    if (sscanf(line, " (%lu.%15[0-9]) %31s %63s", &seconds, fraction, interface, frame_text) != 4) {
+      stats.malformed += line[0] != '\n' && line[0] != '#';
+      continue;
+    }
+    if (strcmp(interface, "tx") == 0) {
+      stats.skipped_tx++;
+      continue;
+    }
+    ReplayFrame replay_frame{};
+    if (!parseFrame(frame_text, replay_frame.frame)) {
+      stats.malformed++;
+      continue;
+    }
+    // fraction digits are not always six
+    uint64_t micros = 0;
+    for (size_t i = 0; i < 6; i++) {
+      micros = micros * 10 + (i < strlen(fraction) ? fraction[i] - '0' : 0);
+    }
+    replay_frame.time_us = seconds * 1000000ULL + micros;
+    frames.push_back(replay_frame);
+    stats.frames++;
+  }
+  fclose(file);
+  return true;
+}
+
+// one firmware loop pass, the master's heartbeat is not on the bus, it arrives every 30 s like in the simulator
+static void tick(Battery& battery, uint64_t& next_heartbeat_us) {
+  if (fake_clock.now_us >= next_heartbeat_us) {
+    next_heartbeat_us += 30ULL * 1000000ULL;
+    fake_mqtt.deliver(mqtt_master_heartbeat_topic, "1");
+  }
+  battery.loop();
+}
+
+void replayCapture(Battery& battery, const std::vector<ReplayFrame>& frames) {
+  if (frames.empty()) {
+    return;
+  }
+  const uint64_t start_us = fake_clock.now_us;
+  const uint64_t first_us = frames.front().time_us;
+  uint64_t next_heartbeat_us = start_us;
+  for (const auto& [time_us, frame] : frames) {
+    const uint64_t at = start_us + (time_us > first_us ? time_us - first_us : 0);
+    // 1 ms ticks up to the frame, periodic frames, init replies and retry deadlines come due in between
+    while (fake_clock.now_us + 1000ULL <= at) {
+      tick(battery, next_heartbeat_us);
+      fake_clock.advanceMillis(1);
+    }
+    if (at > fake_clock.now_us) {
+      fake_clock.now_us = at;  // captures are not always sorted, time never runs backwards
+    }
+    battery.can.readMessage(frame);
+    tick(battery, next_heartbeat_us);
+  }
+}
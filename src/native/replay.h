@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "battery.h"
+#include "hal.h"
+
+struct ReplayFrame {
+  uint64_t time_us;
+  CanFrame frame;
+};
+
+struct ReplayStats {
+  uint64_t lines;
+  uint64_t frames;
+  uint64_t skipped_tx;  // our own transmissions in the capture
+  uint64_t malformed;
+};
+
+// reads a candump -L log ("(seconds) interface ID#DATA"), frames logged on interface "tx" are skipped
+bool loadCapture(const char* path, std::vector<ReplayFrame>& frames, ReplayStats& stats);
+// feeds the frames through CanManager::readMessage with the fake clock following the capture timestamps, the whole
+// Battery loop runs in 1 ms ticks in between (and a master heartbeat every 30 s) so periodic frames, init replies
+// and publishing happen like on the device
+void replayCapture(Battery& battery, const std::vector<ReplayFrame>& frames);
@@ -0,0 +1,94 @@
+#ifdef __linux__
+
+#include "socket_can.h"
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "can_dispatch.h"
+
+SocketCanDriver::~SocketCanDriver() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+bool SocketCanDriver::begin(const CanFilter& filter) {
+  this->filter = filter;
+  fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+  if (fd < 0) {
+    return false;
+  }
+  ifreq request{};
+  strncpy(request.ifr_name, interface, sizeof(request.ifr_name) - 1);
+  if (ioctl(fd, SIOCGIFINDEX, &request) == 0) {
+    sockaddr_can address{};
+    address.can_family = AF_CAN;
+    address.can_ifindex = request.ifr_ifindex;
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+      return true;
+    }
+  }
+  close(fd);
+  fd = -1;
+  return false;
+}
+
+bool SocketCanDriver::transmit(const CanFrame& frame) {
+  if (fd < 0) {
+    return false;
+  }
+  can_frame raw{};
+  raw.can_id = frame.id | (frame.extd ? CAN_EFF_FLAG : 0) | (frame.rtr ? CAN_RTR_FLAG : 0);
+  raw.can_dlc = frame.len;
+  memcpy(raw.data, frame.data, sizeof(raw.data));
+  if (write(fd, &raw, sizeof(raw)) != sizeof(raw)) {
+    if (errno == EAGAIN || errno == ENOBUFS) {
+      return false;  // socket queue full, same as a full TWAI tx queue
+    }
+    pending_alerts |= CAN_ALERT_TX_FAILED;
+    status.bus_error_count++;
+    return true;
+  }
+  pending_alerts |= CAN_ALERT_TX_SUCCESS;
+  return true;
+}
+
+bool SocketCanDriver::receive(CanFrame& frame) {
+  can_frame raw{};
+  while (fd >= 0 && read(fd, &raw, sizeof(raw)) == sizeof(raw)) {
+    if (raw.can_id & CAN_ERR_FLAG) {
+      continue;
+    }
+    frame = {};
+    frame.extd = raw.can_id & CAN_EFF_FLAG;
+    frame.rtr = raw.can_id & CAN_RTR_FLAG;
+    frame.id = raw.can_id & (frame.extd ? CAN_EFF_MASK : CAN_SFF_MASK);
+    frame.len = raw.can_dlc > 8 ? 8 : raw.can_dlc;
+    memcpy(frame.data, raw.data, frame.len);
+    if (canFilterAccepts(filter, frame)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+uint32_t SocketCanDriver::readAlerts(const unsigned long timeout_ms) {
+  uint32_t alerts = pending_alerts;
+  pending_alerts = 0;
+  pollfd waiter{fd, POLLIN, 0};
+  if (fd >= 0 && poll(&waiter, 1, alerts ? 0 : static_cast<int>(timeout_ms)) > 0 && (waiter.revents & POLLIN)) {
+    alerts |= CAN_ALERT_RX_DATA;
+  }
+  return alerts;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <chrono>
+
+#include "hal.h"
+
+// wall clock for runs against real interfaces, starts at zero like the esp32 after boot
+class HostClock final : public Clock {
+ public:
+  unsigned long millis() override { return static_cast<unsigned long>(elapsed().count() / 1000); }
+  unsigned long micros() override { return static_cast<unsigned long>(elapsed().count()); }
+
+ private:
+  const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  std::chrono::microseconds elapsed() const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+  }
+};
+
+// linux SocketCAN backend (vcan or a real adapter), the TWAI acceptance filter is applied in software so the
+// firmware sees exactly what the esp32 would let through
+class SocketCanDriver final : public CanDriver {
+ public:
+  explicit SocketCanDriver(const char* interface) : interface(interface) {}
+  SocketCanDriver(const SocketCanDriver&) = delete;
+  SocketCanDriver& operator=(const SocketCanDriver&) = delete;
+  ~SocketCanDriver() override;
+
+  bool begin(const CanFilter& filter) override;
+  bool transmit(const CanFrame& frame) override;
+  bool receive(CanFrame& frame) override;
+  uint32_t readAlerts(unsigned long timeout_ms) override;
+  void getStatus(CanStatus& status) override { status = this->status; }
+
+ private:
+  const char* interface;
+  int fd = -1;
+  CanFilter filter{0, 0xFFFFFFFF, true};
+  uint32_t pending_alerts = 0;
+  CanStatus status{};
+};
+
+#endif
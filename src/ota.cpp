@@ -0,0 +1,116 @@
+#include "ota.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "battery.h"
+
+Ota::Ota(Battery& battery) : battery(battery), hal(battery.hal) {}
+
+bool Ota::start(const char* path) {
+  if (current.load(std::memory_order_acquire) != idle || strlen(path) >= sizeof(this->path)) {
+    return false;
+  }
+  strcpy(this->path, path);
+  received_bytes = 0;
+  image_size = 0;
+  reported_percent = 0;
+  started_ms = last_data_ms = hal.clock->millis();
+  // the task may finish before startTask() returns, so it must see its mode by then
+  polled = false;
+  current.store(connecting, std::memory_order_release);
+  if (!hal.board->startTask(task, "ota", ota_task_stack_size, ota_task_priority, this)) {
+    polled = true;
+  }
+  return true;
+}
+
+void Ota::task(void* arg) {
+  Ota& ota = *static_cast<Ota*>(arg);
+  while (ota.step()) {
+  }
+}
+
+bool Ota::step() {
+  if (current.load(std::memory_order_relaxed) == connecting) {
+    uint32_t size = 0;
+    if (!hal.updater->begin(path, size, message, sizeof(message))) {
+      return finish(false);
+    }
+    if (size == 0) {
+      snprintf(message, sizeof(message), "ota empty image");
+      hal.updater->end(false, nullptr, 0);
+      return finish(false);
+    }
+    image_size = size;
+    last_data_ms = hal.clock->millis();
+    current.store(downloading, std::memory_order_release);
+    return true;
+  }
+  const uint32_t done_bytes = received_bytes.load(std::memory_order_relaxed);
+  const uint32_t left = image_size.load(std::memory_order_relaxed) - done_bytes;
+  const int n = hal.updater->read(chunk, left < sizeof(chunk) ? left : sizeof(chunk));
+  if (n == 0 && hal.clock->millis() - last_data_ms < ota_stall_timeout_ms) {
+    return true;
+  }
+  if (n <= 0 || !hal.updater->write(chunk, n)) {
+    const char* reason = n < 0 ? "connection lost" : n == 0 ? "stalled" : "flash write failed";
+    snprintf(message, sizeof(message), "ota %s at %lu bytes", reason, static_cast<unsigned long>(done_bytes));
+    hal.updater->end(false, nullptr, 0);
+    return finish(false);
+  }
+  last_data_ms = hal.clock->millis();
+  led = !led;  // one blink per chunk like under httpUpdate's led pin, a running update shows on the board
+  hal.board->setLed(led);
+  received_bytes.store(done_bytes + n, std::memory_order_relaxed);
+  if (done_bytes + n < image_size.load(std::memory_order_relaxed)) {
+    return true;
+  }
+  return finish(hal.updater->end(true, message, sizeof(message)));
+}
+
+bool Ota::finish(const bool ok) {
+  led = false;
+  hal.board->setLed(false);
+  stack_free = polled ? 0 : hal.board->stackFree();  // the handshake is behind us, this is the deepest it got
+  current.store(ok ? done : failed, std::memory_order_release);
+  return false;
+}
+
+void Ota::loop() {
+  if (polled && (state() == connecting || state() == downloading)) {
+    step();
+  }
+  const State state = current.load(std::memory_order_acquire);
+  if (state == idle || state == connecting) {
+    return;
+  }
+  const uint32_t size = image_size.load(std::memory_order_relaxed);
+  if (state == downloading) {
+    const auto percent = static_cast<uint8_t>(static_cast<uint64_t>(received()) * 100U / size);
+    if (percent >= reported_percent + ota_progress_step_percent) {
+      reported_percent = percent - percent % ota_progress_step_percent;
+      battery.mqtt.publish("ota/progress", static_cast<uint32_t>(reported_percent));
+    }
+    return;
+  }
+  char line[max_mqtt_payload_length + 32];
+  snprintf(line, sizeof(line), "%s (%lu bytes in %lu ms)", message, static_cast<unsigned long>(received()),
+           hal.clock->millis() - started_ms);
+  hal.log->println(line);
+  battery.mqtt.log(line, false);
+  if (stack_free != 0) {
+    snprintf(line, sizeof(line), "ota task stack: %lu of %lu bytes never used%s",
+             static_cast<unsigned long>(stack_free), static_cast<unsigned long>(ota_task_stack_size),
+             stack_free < ota_task_min_stack_free ? ", too few" : "");
+    hal.log->println(line);
+    battery.mqtt.log(line, false);
+  }
+  current.store(idle, std::memory_order_release);
+  if (state == done) {
+    battery.mqtt.publish("ota/progress", 100U, false, false);  // the queue would go down with the restart
+    battery.mqtt.log("ota done - restarting!", false);
+    battery.store.flush();
+    hal.board->restart();
+  }
+}
@@ -0,0 +1,89 @@
+#include "settings_store.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "battery.h"
+
+// bumped whenever the meaning of a slot changes, a blob of another layout is ignored and the defaults stay
+static constexpr uint32_t blob_magic = 0x53450100UL | Telemetry::count;
+static constexpr char blob_key[] = "settings";
+
+SettingsStore::SettingsStore(Battery& battery) : battery(battery), hal(battery.hal) {}
+
+void SettingsStore::snapshot(float* values) const {
+  for (int i = 0; i < Telemetry::count; i++) {
+    const float* value = battery.can.settings[i].valuePtr;
+    values[i] = value ? *value : 0.f;
+  }
+}
+
+bool SettingsStore::load() {
+  Blob blob;
+  const bool valid = hal.storage->load(blob_key, &blob, sizeof(blob)) && blob.magic == blob_magic;
+  if (valid) {
+    for (int i = 0; i < Telemetry::count; i++) {
+      if (float* value = battery.can.settings[i].valuePtr; value && std::isfinite(blob.values[i])) {
+        *value = blob.values[i];
+      }
+    }
+  }
+  snapshot(stored);
+  snapshot(seen);
+  dirty = significant = false;
+  last_flush = hal.clock->millis();
+  hal.log->printf("settings: %s\n", valid ? "restored" : "defaults");
+  return valid;
+}
+
+void SettingsStore::loop() {
+  const unsigned long now = hal.clock->millis();
+  float current[Telemetry::count];
+  snapshot(current);
+  bool changed = false;
+  for (int i = 0; i < Telemetry::count; i++) {
+    if (current[i] == seen[i]) {
+      continue;
+    }
+    changed = true;
+    seen[i] = current[i];
+    // a tenth of the stored value (at least 1) counts as significant, e.g. a new limit rather than soc creeping up
+    significant |= std::fabs(current[i] - stored[i]) >= 0.1f * std::fmax(std::fabs(stored[i]), 1.f);
+  }
+  if (changed) {
+    stats.coalesced += dirty;
+    if (!dirty) {
+      dirty = true;
+      dirty_since = now;
+    }
+    last_change = now;
+  }
+  if (!dirty) {
+    return;
+  }
+  if (now - last_change >= settings_flush_quiet_ms || now - dirty_since >= settings_flush_max_delay_ms ||
+      (significant && now - last_flush >= settings_flush_min_interval_ms)) {
+    flush();
+  }
+}
+
+bool SettingsStore::flush() {
+  Blob blob{blob_magic, {}};
+  snapshot(blob.values);
+  if (!dirty && std::equal(blob.values, blob.values + Telemetry::count, stored)) {
+    return true;  // also catches a set that came in after the last loop()
+  }
+  const bool ok = hal.storage->save(blob_key, &blob, sizeof(blob));
+  last_flush = hal.clock->millis();
+  if (!ok) {
+    stats.failed++;
+    last_change = last_flush;  // stays dirty, retried after another quiet period
+    return false;
+  }
+  for (int i = 0; i < Telemetry::count; i++) {
+    stored[i] = seen[i] = blob.values[i];
+  }
+  dirty = significant = false;
+  stats.flushes++;
+  return true;
+}
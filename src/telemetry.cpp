@@ -0,0 +1,188 @@
+#include "telemetry.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#include "battery.h"
+#include "fixed_point.h"
+#include "hal.h"
+#include "main_vars.h"
+#include "perfect_hash.h"
+
+struct TelemetryInfo {
+  const char* topic;
+  PublishPolicy policy;
+  uint8_t decimals;  // resolution of the signal on the bus
+};
+
+static constexpr PublishPolicy limit_policy{0, publish_min_interval_ms, publish_refresh_interval_ms};
+static constexpr PublishPolicy voltage_policy{0.5, publish_min_interval_ms, publish_refresh_interval_ms};
+static constexpr PublishPolicy current_policy{0.2, publish_min_interval_ms, publish_refresh_interval_ms};
+static constexpr PublishPolicy temp_policy{0.5, publish_min_interval_ms, publish_refresh_interval_ms};
+static constexpr PublishPolicy percent_policy{0.1, publish_min_interval_ms, publish_refresh_interval_ms};
+static constexpr PublishPolicy capacity_policy{0.5, publish_min_interval_ms, publish_refresh_interval_ms};
+static constexpr PublishPolicy timestamp_policy{0, publish_min_interval_ms, publish_refresh_interval_ms};
+
+// indexed by Telemetry::Id
+static constexpr TelemetryInfo telemetry_info[Telemetry::count] = {
+    {"limits/max_voltage", limit_policy, 1},
+    {"limits/min_voltage", limit_policy, 1},
+    {"limits/max_discharge_current", limit_policy, 1},
+    {"limits/max_charge_current", limit_policy, 1},
+    {"battery/voltage", voltage_policy, 1},
+    {"battery/current", current_policy, 1},
+    {"battery/temp", temp_policy, 1},
+    {"battery/max_cell_temp", temp_policy, 1},
+    {"battery/min_cell_temp", temp_policy, 1},
+    {"battery/soc", percent_policy, 2},
+    {"battery/soh", percent_policy, 2},
+    {"battery/remaining_capacity_ah", capacity_policy, 1},
+    {"battery/full_capacity_ah", capacity_policy, 1},
+    {"inverter/battery_voltage", voltage_policy, 1},
+    {"inverter/battery_current", current_policy, 1},
+    {"inverter/temperature", temp_policy, 1},
+    {"inverter/soc", percent_policy, 1},
+    {"inverter/timestamp", timestamp_policy, 0},
+};
+
+static constexpr std::array<std::string_view, Telemetry::count> telemetryTopics() {
+  std::array<std::string_view, Telemetry::count> topics{};
+  for (size_t i = 0; i < topics.size(); i++) {
+    topics[i] = telemetry_info[i].topic;
+  }
+  return topics;
+}
+
+static constexpr PerfectHash<Telemetry::count, 64> topic_hash(telemetryTopics());
+static_assert(topic_hash.valid(), "no collision free seed for the telemetry topics");
+
+Telemetry::Telemetry(Battery& battery)
+    : mode(telemetry_snapshot ? both : topics), battery(battery), hal(battery.hal) {}
+
+void Telemetry::init() {
+  for (uint8_t id = 0; id < count; id++) {
+    handles[id] = battery.mqtt.registerTopic(telemetry_info[id].topic);
+  }
+}
+
+const char* Telemetry::topic(const Id id) { return telemetry_info[id].topic; }
+
+uint8_t Telemetry::decimals(const Id id) { return telemetry_info[id].decimals; }
+
+Telemetry::Id Telemetry::find(const std::string_view topic) {
+  const int index = topic_hash.find(topic);
+  return index < 0 ? count : static_cast<Id>(index);
+}
+
+bool Telemetry::accept(const Id id, const double value) {
+  stats.offered++;
+  if (!filters[id].shouldPublish(value, hal.clock->millis(), telemetry_info[id].policy)) {
+    stats.suppressed++;
+    return false;
+  }
+  stats.published++;
+  return true;
+}
+
+void Telemetry::publish(const Id id, const float value) {
+  latest[id] = toScaled(value, telemetry_info[id].decimals);
+  have[id] = dirty = true;
+  if (mode != snapshot && accept(id, value)) {
+    send(id);
+  }
+}
+
+void Telemetry::publish(const Id id, const uint32_t value) {
+  latest[id] = static_cast<int32_t>(value);  // only inverter_timestamp, formatted unsigned again
+  have[id] = dirty = true;
+  if (mode != snapshot && accept(id, value)) {
+    send(id);
+  }
+}
+
+void Telemetry::send(const Id id) {
+  if (id == inverter_timestamp) {
+    battery.mqtt.publish(handles[id], static_cast<uint32_t>(latest[id]));
+    return;
+  }
+  char payload[16];
+  formatFixed(latest[id], telemetry_info[id].decimals, payload, sizeof(payload));
+  battery.mqtt.publish(handles[id], payload);
+}
+
+void Telemetry::invalidate() {
+  for (auto& filter : filters) {
+    filter.invalidate();
+  }
+}
+
+void Telemetry::publishStats() {
+  battery.mqtt.publish("stats/publish_offered", stats.offered);
+  battery.mqtt.publish("stats/publish_sent", stats.published);
+  battery.mqtt.publish("stats/publish_suppressed", stats.suppressed);
+  battery.mqtt.publish("stats/publish_snapshots", stats.snapshots);
+}
+
+bool Telemetry::setMode(const char* name) {
+  static constexpr const char* names[] = {"topics", "snapshot", "both"};
+  for (uint8_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+    if (strcmp(name, names[i]) == 0) {
+      mode = static_cast<Mode>(i);
+      invalidate();  // per topic consumers get a full set again after switching back
+      return true;
+    }
+  }
+  return false;
+}
+
+void Telemetry::loop() {
+  if (mode != snapshot) {
+    // changes the rate limit held back go out once their interval is over, not only with the next refresh
+    for (uint8_t id = 0; id < count; id++) {
+      if (filters[id].flushDue(hal.clock->millis(), telemetry_info[id].policy)) {
+        stats.published++;
+        send(static_cast<Id>(id));
+      }
+    }
+  }
+  if (mode == topics || !dirty || hal.clock->millis() - last_snapshot_time < telemetry_snapshot_interval_ms) {
+    return;
+  }
+  last_snapshot_time = hal.clock->millis();
+  if (hal.mqtt->connected()) {
+    publishSnapshot();
+  }
+}
+
+// {"seq":n,"uptime_ms":n,"time":epoch,"limits/max_voltage":n,...}, time only once sntp has set the clock
+void Telemetry::publishSnapshot() {
+  dirty = false;
+  char json[768];
+  int pos = snprintf(json, sizeof(json), "{\"seq\":%lu,\"uptime_ms\":%lu", static_cast<unsigned long>(++snapshot_seq),
+                     hal.clock->millis());
+  const time_t now = time(nullptr);
+  if (now >= static_cast<time_t>(min_time_s) && pos > 0 && static_cast<size_t>(pos) < sizeof(json)) {
+    pos += snprintf(json + pos, sizeof(json) - pos, ",\"time\":%lld", static_cast<long long>(now));
+  }
+  for (uint8_t id = 0; id < count && pos > 0 && static_cast<size_t>(pos) < sizeof(json); id++) {
+    if (!have[id]) {
+      continue;
+    }
+    char value[16];
+    if (id == inverter_timestamp) {
+      snprintf(value, sizeof(value), "%lu", static_cast<unsigned long>(static_cast<uint32_t>(latest[id])));
+    } else {
+      formatFixed(latest[id], telemetry_info[id].decimals, value, sizeof(value));
+    }
+    pos += snprintf(json + pos, sizeof(json) - pos, ",\"%s\":%s", telemetry_info[id].topic, value);
+  }
+  if (pos <= 0 || static_cast<size_t>(pos) + 2 > sizeof(json)) {
+    hal.log->println("telemetry snapshot too long");
+    return;
+  }
+  snprintf(json + pos, sizeof(json) - pos, "}");
+  stats.snapshots++;
+  // one packet instead of one per value, too long for the queue slots so it goes out directly
+  battery.mqtt.publish("telemetry", json, false, false);
+}
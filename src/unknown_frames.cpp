@@ -0,0 +1,136 @@
+#include "unknown_frames.h"
+
+#include <cstdio>
+#include <cstring>
+
+#include "battery.h"
+#include "can_dispatch.h"
+#include "can_trace.h"
+#include "fixed_point.h"
+
+UnknownFrames::UnknownFrames(Battery& battery) : battery(battery), hal(battery.hal) {}
+
+void UnknownFrames::record(const CanFrame& frame) {
+  const uint32_t key = canDispatchKey(frame);
+  const unsigned long now_us = hal.clock->micros();
+  for (size_t i = canDispatchSlot(key, can_unknown_slots);; i = (i + 1) & (can_unknown_slots - 1)) {
+    UnknownFrame& slot = slots[i];
+    const uint32_t count = slot.count.load(std::memory_order_relaxed);
+    if (count == 0) {
+      if (used.load(std::memory_order_relaxed) >= can_unknown_slots / 4 * 3) {
+        overflow++;  // keep the probe chains short
+        return;
+      }
+      slot.key = key;
+      slot.first_ms = slot.last_ms = hal.clock->millis();
+      slot.last_us = now_us;
+      slot.period_us = 0;
+    } else if (slot.key != key) {
+      continue;
+    } else {
+      const auto gap = static_cast<uint32_t>(now_us - slot.last_us);
+      slot.period_us = slot.period_us == 0 ? gap : slot.period_us - slot.period_us / 16 + gap / 16;
+      slot.last_ms = hal.clock->millis();
+      slot.last_us = now_us;
+    }
+    slot.len = frame.len;
+    slot.flags = (frame.extd ? 0x1 : 0) | (frame.rtr ? 0x2 : 0);
+    std::memcpy(slot.data, frame.data, sizeof(slot.data));
+    slot.count.store(count + 1, std::memory_order_release);
+    if (count == 0) {
+      used.fetch_add(1, std::memory_order_release);
+    }
+    return;
+  }
+}
+
+void UnknownFrames::loop() {
+  for (unsigned int i = 0; i < can_capture_dump_per_poll && dump_next < can_unknown_slots; dump_next++) {
+    if (slots[dump_next].count.load(std::memory_order_acquire)) {
+      dumpLine(slots[dump_next]);
+      i++;
+    }
+  }
+  if (can_unknown_digest_interval_ms && hal.clock->millis() - last_digest_ms >= can_unknown_digest_interval_ms) {
+    last_digest_ms = hal.clock->millis();
+    digest();
+  }
+}
+
+void UnknownFrames::dump() { dump_next = 0; }
+
+// longest dump line: extended id, 8 data bytes, 32 bit counters and times
+static_assert(sizeof("1FFFFFFF#0011223344556677 count 4294967295 first 4294967295 ms last 4294967295 ms period "
+                     "4294967.2 ms") <= max_mqtt_payload_length,
+              "unknown/frames lines must fit a mqtt queue slot");
+
+void UnknownFrames::dumpLine(const UnknownFrame& slot) {
+  CanFrame frame{};
+  frame.id = slot.key & ~can_dispatch_extended;
+  frame.extd = slot.flags & 0x1;
+  frame.rtr = slot.flags & 0x2;
+  frame.len = slot.len;
+  std::memcpy(frame.data, slot.data, sizeof(frame.data));
+  char period[12];
+  formatFixed(static_cast<int32_t>(slot.period_us / 100U), 1, period, sizeof(period));
+  char line[max_mqtt_payload_length];
+  formatFrame(frame, line, sizeof(line));
+  const size_t pos = strlen(line);
+  snprintf(line + pos, sizeof(line) - pos, " count %lu first %lu ms last %lu ms period %s ms",
+           static_cast<unsigned long>(slot.count.load(std::memory_order_relaxed)), slot.first_ms, slot.last_ms, period);
+  battery.mqtt.publish("unknown/frames", line, false, true, 5);
+}
+
+// longest digest: every counter at its widest and can_unknown_digest_top extended ids, so it is never cut short
+static constexpr size_t digest_size = 384;
+static constexpr size_t digest_longest =
+    sizeof("{\"ids\":4294967295,\"new_ids\":4294967295,\"frames\":4294967295,\"total\":4294967295,"
+           "\"overflow\":4294967295,\"busiest\":{}}") +
+    can_unknown_digest_top * (sizeof(",\"1fffffff\":[4294967295,4294967.2]") - 1);
+static_assert(digest_longest <= digest_size, "the unknown digest must fit its buffer");
+
+// the busiest ids of the interval with their frame count and period, the totals count since boot
+void UnknownFrames::digest() {
+  uint32_t frames[can_unknown_slots];
+  uint32_t total = 0, interval_total = 0;
+  for (size_t i = 0; i < can_unknown_slots; i++) {
+    const uint32_t count = slots[i].count.load(std::memory_order_acquire);
+    frames[i] = count - digested[i];
+    digested[i] = count;
+    total += count;
+    interval_total += frames[i];
+  }
+  const uint32_t ids_now = ids();
+  const uint32_t new_ids = ids_now - digested_ids;
+  digested_ids = ids_now;
+  if (interval_total == 0 || !hal.mqtt->connected()) {
+    return;  // nothing unknown on the bus, stay quiet
+  }
+  char json[digest_size];
+  int pos = snprintf(json, sizeof(json),
+                     "{\"ids\":%lu,\"new_ids\":%lu,\"frames\":%lu,\"total\":%lu,\"overflow\":%lu,\"busiest\":{",
+                     static_cast<unsigned long>(ids_now), static_cast<unsigned long>(new_ids),
+                     static_cast<unsigned long>(interval_total), static_cast<unsigned long>(total),
+                     static_cast<unsigned long>(overflow));
+  // per id: [frames in the interval, period ms], picked by repeated max, the list is short
+  for (unsigned int n = 0; n < can_unknown_digest_top; n++) {
+    size_t busiest = 0;
+    for (size_t i = 1; i < can_unknown_slots; i++) {
+      busiest = frames[i] > frames[busiest] ? i : busiest;
+    }
+    if (frames[busiest] == 0) {
+      break;
+    }
+    const UnknownFrame& slot = slots[busiest];
+    char period[12];
+    formatFixed(static_cast<int32_t>(slot.period_us / 100U), 1, period, sizeof(period));
+    const bool extended = slot.key & can_dispatch_extended;
+    pos += snprintf(json + pos, sizeof(json) - pos, extended ? "%s\"%08lx\":[%lu,%s]" : "%s\"%03lx\":[%lu,%s]",
+                    n ? "," : "", static_cast<unsigned long>(slot.key & ~can_dispatch_extended),
+                    static_cast<unsigned long>(frames[busiest]), period);
+    frames[busiest] = 0;
+  }
+  snprintf(json + pos, sizeof(json) - pos, "}}");
+  // too long for the queue slots, goes out directly
+  battery.mqtt.publish("unknown", json, false, false);
+}
@@ -1,14 +1,20 @@
 #include "wifi_manager.h"
 
 #include <Arduino.h>
+#include <WiFi.h>
 
+#include "battery.h"
 #include "config.h"
 #include "main_vars.h"
-#include "mqtt_manager.h"
 
-void WifiManager::connect() {
-  Serial.println();
-  Serial.printf("Connecting to %s.", ssid);
+bool WifiManager::connected = false;
+bool WifiManager::time_synced = false;
+bool WifiManager::sntp_timeout_logged = false;
+unsigned long WifiManager::attempt_start = 0;
+unsigned long WifiManager::connected_time = 0;
+
+void WifiManager::begin() {
+  Serial.printf("Connecting to %s in the background.\n", ssid);
   WiFi.persistent(false);
   WiFi.softAPdisconnect(true);
   WiFi.setAutoReconnect(true);
@@ -19,15 +25,38 @@ void WifiManager::connect() {
 #ifdef LOLIN_C3_MINI_V1
   WiFi.setTxPower(WIFI_POWER_8_5dBm);
 #endif
-  const unsigned long start = millis();
-  while (WiFi.status() != WL_CONNECTED) {
-    if (millis() - start >= wifi_timeout_ms) {
-      ESP.restart();
+  attempt_start = millis();
+}
+
+void WifiManager::loop(Battery& battery) {
+  if (!connected) {
+    if (WiFi.status() == WL_CONNECTED) {
+      onConnected(battery);
+    } else if (millis() - attempt_start >= wifi_timeout_ms) {
+      // no restart any more, that would take the battery off the can bus as well
+      Serial.println("WiFi timeout, retrying.");
+      WiFi.disconnect();
+      WiFi.begin(ssid, password);
+      attempt_start = millis();
     }
-    delay(500);
-    Serial.print(".");
+    return;
+  }
+  if (time_synced) {
+    return;
+  }
+  if (time(nullptr) >= min_time_s) {
+    onTimeSynced(battery);
+  } else if (!sntp_timeout_logged && millis() - connected_time >= sntp_timeout_ms) {
+    sntp_timeout_logged = true;  // keeps trying in the background
+    Serial.println("SNTP-Sync timeout!");
   }
-  Serial.println("\nWiFi connected!");
+}
+
+void WifiManager::onConnected(Battery& battery) {
+  connected = true;
+  connected_time = millis();
+  battery.boot.mark(BootTimeline::wifi_connected, micros());
+  Serial.println("WiFi connected!");
   const String localIP = WiFi.localIP().toString();
   Serial.printf("IP Address: %s\n", localIP.c_str());
 
@@ -35,27 +64,19 @@ void WifiManager::connect() {
     const String dns = WiFi.dnsIP(i).toString();
     Serial.printf("DNS%d: %s\n", i + 1, dns.c_str());
   }
+  configTzTime("CET-1CEST,M3.5.0,M10.5.0/3", "0.de.pool.ntp.org", "1.de.pool.ntp.org", "2.de.pool.ntp.org");
+  battery.connect();
 }
 
-void WifiManager::syncTime() {
-  Serial.print("Setting time using SNTP.");
-  configTzTime("CET-1CEST,M3.5.0,M10.5.0/3", "0.de.pool.ntp.org", "1.de.pool.ntp.org", "2.de.pool.ntp.org");
-  time_t now = time(nullptr);
-  const unsigned long start = millis();
-  while (now < min_time_s && millis() - start < sntp_timeout_ms) {
-    delay(500);
-    Serial.print(".");
-    now = time(nullptr);
-  }
-  if (now < min_time_s) {
-    Serial.println("\nSNTP-Sync timeout!");
-    return;
-  }
-  Serial.println("\nTime synchronized!");
+void WifiManager::onTimeSynced(Battery& battery) {
+  time_synced = true;
+  battery.boot.mark(BootTimeline::time_synced, micros());
+  Serial.println("Time synchronized!");
   tm timeInfo{};
   getLocalTime(&timeInfo);
   char current_time_buffer[32];
   strftime(current_time_buffer, sizeof(current_time_buffer), "%c", &timeInfo);
-  Serial.printf("Current time: %s", current_time_buffer);
-  MqttManager::publish("last_boot", current_time_buffer, true);
+  Serial.printf("Current time: %s\n", current_time_buffer);
+  battery.mqtt.publish("last_boot", current_time_buffer, true);
+  battery.mqtt.publishBootTimeline();
 }
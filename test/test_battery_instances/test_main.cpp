@@ -0,0 +1,149 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <string>
+
+#include "battery.h"
+#include "fake_hal.h"
+
+// two batteries in one process on their own fake bus and broker session under one clock: nothing leaks across
+
+void setUp() { fake_clock.now_us = 0; }
+
+void tearDown() {}
+
+static CanFrame inverterFrame(const uint32_t id, const uint16_t a, const uint16_t b, const uint16_t c) {
+  CanFrame frame{};
+  frame.id = id;
+  frame.len = 8;
+  frame.data[0] = a >> 8;
+  frame.data[1] = a;
+  frame.data[2] = b >> 8;
+  frame.data[3] = b;
+  frame.data[4] = c >> 8;
+  frame.data[5] = c;
+  return frame;
+}
+
+static uint16_t word(const CanFrame& frame, const uint8_t offset) {
+  return static_cast<uint16_t>(frame.data[offset] << 8 | frame.data[offset + 1]);
+}
+
+// the last frame with this id a node put on its bus, nullptr if none
+static const CanFrame* lastSent(const FakeNode& node, const uint32_t id) {
+  for (auto it = node.can.tx.rbegin(); it != node.can.tx.rend(); ++it) {
+    if (it->id == id) {
+      return &*it;
+    }
+  }
+  return nullptr;
+}
+
+static void run(Battery& a, Battery& b, const unsigned long ms) {
+  for (unsigned long i = 0; i < ms; i++) {
+    a.loop();
+    b.loop();
+    fake_clock.advanceMillis(1);
+  }
+}
+
+struct Fleet {
+  Fleet() : a(node_a.hal, "sim/0/"), b(node_b.hal, "sim/1/") {
+    for (FakeNode* node : {&node_a, &node_b}) {
+      node->can.keep_tx = true;
+      node->mqtt.keep_published = true;
+    }
+    a.begin();
+    b.begin();
+    a.connect();
+    b.connect();
+  }
+
+  FakeNode node_a;
+  FakeNode node_b;
+  Battery a;
+  Battery b;
+};
+
+void test_modules_belong_to_their_battery() {
+  Fleet fleet;
+  TEST_ASSERT_TRUE(&fleet.a.hal == &fleet.node_a.hal);
+  TEST_ASSERT_TRUE(&fleet.b.hal == &fleet.node_b.hal);
+  TEST_ASSERT_TRUE(fleet.node_a.can.started);
+  TEST_ASSERT_TRUE(fleet.node_b.can.started);
+  TEST_ASSERT_FALSE(&fleet.a.can.soc_percent == &fleet.b.can.soc_percent);
+  TEST_ASSERT_TRUE(fleet.a.can.settings[Telemetry::battery_soc].valuePtr == &fleet.a.can.soc_percent);
+  TEST_ASSERT_TRUE(fleet.b.can.settings[Telemetry::battery_soc].valuePtr == &fleet.b.can.soc_percent);
+  TEST_ASSERT_EQUAL_FLOAT(fleet.a.can.limit_battery_voltage_max, fleet.b.can.limit_battery_voltage_max);
+}
+
+// a set on one session changes that battery's value and its frames only
+void test_set_reaches_only_its_battery() {
+  Fleet fleet;
+  run(fleet.a, fleet.b, 100);
+  const float default_max = fleet.b.can.limit_battery_voltage_max;
+  fleet.node_a.mqtt.deliver("sim/0/limits/max_voltage/set", "240.5");
+  fleet.node_b.mqtt.deliver("sim/0/limits/max_voltage/set", "199");  // not b's module topic, must not match
+  run(fleet.a, fleet.b, 1000);
+  TEST_ASSERT_EQUAL_FLOAT(240.5f, fleet.a.can.limit_battery_voltage_max);
+  TEST_ASSERT_EQUAL_FLOAT(default_max, fleet.b.can.limit_battery_voltage_max);
+
+  const CanFrame* limits_a = lastSent(fleet.node_a, 0x110);
+  const CanFrame* limits_b = lastSent(fleet.node_b, 0x110);
+  TEST_ASSERT_NOT_NULL(limits_a);
+  TEST_ASSERT_NOT_NULL(limits_b);
+  TEST_ASSERT_EQUAL_UINT16(2405, word(*limits_a, 0));
+  TEST_ASSERT_EQUAL_UINT16(static_cast<uint16_t>(default_max * 10 + 0.5f), word(*limits_b, 0));
+}
+
+// inverter frames on one bus are decoded by that battery only
+void test_frames_reach_only_their_battery() {
+  Fleet fleet;
+  fleet.node_a.can.inject(inverterFrame(0x91, 2150, 43, 220));
+  fleet.node_b.can.inject(inverterFrame(0x91, 1990, 0, 310));
+  fleet.node_b.can.inject(inverterFrame(0xd1, 475, 0, 0));
+  run(fleet.a, fleet.b, 50);
+  TEST_ASSERT_EQUAL_FLOAT(215.0f, fleet.a.can.inverter_battery_voltage);
+  TEST_ASSERT_EQUAL_FLOAT(22.0f, fleet.a.can.inverter_temperature);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, fleet.a.can.inverter_soc);
+  TEST_ASSERT_EQUAL_FLOAT(199.0f, fleet.b.can.inverter_battery_voltage);
+  TEST_ASSERT_EQUAL_FLOAT(31.0f, fleet.b.can.inverter_temperature);
+  TEST_ASSERT_EQUAL_FLOAT(47.5f, fleet.b.can.inverter_soc);
+}
+
+// every message goes out on the own session under the own module topic, and both send the same periodic frames
+void test_topics_and_traffic_stay_apart() {
+  Fleet fleet;
+  run(fleet.a, fleet.b, 10000);
+  TEST_ASSERT_GREATER_THAN(0, fleet.node_a.mqtt.published.size());
+  TEST_ASSERT_GREATER_THAN(0, fleet.node_b.mqtt.published.size());
+  for (const auto& message : fleet.node_a.mqtt.published) {
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE("sim/0/", message.topic.c_str(), 6, message.topic.c_str());
+  }
+  for (const auto& message : fleet.node_b.mqtt.published) {
+    TEST_ASSERT_EQUAL_STRING_LEN_MESSAGE("sim/1/", message.topic.c_str(), 6, message.topic.c_str());
+  }
+  TEST_ASSERT_GREATER_THAN(0, fleet.node_a.can.tx_count);
+  TEST_ASSERT_EQUAL_UINT32(fleet.node_a.can.tx_count, fleet.node_b.can.tx_count);
+  TEST_ASSERT_EQUAL_UINT(0, fleet.node_a.board.restarts);
+  TEST_ASSERT_EQUAL_UINT(0, fleet.node_b.board.restarts);
+}
+
+// a restart command restarts the board it was sent to
+void test_restart_stays_local() {
+  Fleet fleet;
+  fleet.node_b.mqtt.deliver("sim/1/restart", "");
+  run(fleet.a, fleet.b, 10);
+  TEST_ASSERT_EQUAL_UINT(0, fleet.node_a.board.restarts);
+  TEST_ASSERT_EQUAL_UINT(1, fleet.node_b.board.restarts);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_modules_belong_to_their_battery);
+  RUN_TEST(test_set_reaches_only_its_battery);
+  RUN_TEST(test_frames_reach_only_their_battery);
+  RUN_TEST(test_topics_and_traffic_stay_apart);
+  RUN_TEST(test_restart_stays_local);
+  return UNITY_END();
+}
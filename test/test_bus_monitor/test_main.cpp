@@ -0,0 +1,312 @@
+#include <unity.h>
+
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "battery.h"
+#include "bus_monitor.h"
+#include "fake_hal.h"
+
+// frameBits against hand counted frames, the worst case bounds and a bit by bit transmitter, and the bus summary json
+// stays valid whatever the interval held, with every frame counted somewhere
+
+static FakeNode* node;
+static Battery* battery;
+
+// just enough of a json parser to tell valid from invalid: objects, arrays, strings without escapes, numbers
+struct Json {
+  const char* p;
+
+  bool value() {
+    if (*p == '{') {
+      return container('}', true);
+    }
+    if (*p == '[') {
+      return container(']', false);
+    }
+    if (*p == '"') {
+      return string();
+    }
+    return number();
+  }
+  bool container(const char close, const bool object) {
+    p++;
+    if (*p == close) {
+      p++;
+      return true;
+    }
+    for (;;) {
+      if (object && !(string() && *p++ == ':')) {
+        return false;
+      }
+      if (!value()) {
+        return false;
+      }
+      if (*p == close) {
+        p++;
+        return true;
+      }
+      if (*p++ != ',') {
+        return false;
+      }
+    }
+  }
+  bool string() {
+    if (*p++ != '"') {
+      return false;
+    }
+    while (*p && *p != '"') {
+      p++;
+    }
+    return *p++ == '"';
+  }
+  bool number() {
+    const char* start = p;
+    p += *p == '-';
+    while (isdigit(static_cast<unsigned char>(*p)) || *p == '.') {
+      p++;
+    }
+    return p > start && isdigit(static_cast<unsigned char>(p[-1]));
+  }
+};
+
+static bool validJson(const std::string& text) {
+  Json json{text.c_str()};
+  return json.value() && *json.p == '\0';
+}
+
+static CanFrame frame(const uint32_t id, const bool extd) {
+  CanFrame frame{};
+  frame.id = id;
+  frame.extd = extd;
+  frame.len = 8;
+  return frame;
+}
+
+// closes the interval and returns what went out on the bus topic
+static std::string closeInterval() {
+  fake_clock.advanceMillis(bus_monitor_interval_ms);
+  battery->monitor.alerts(0, CanStatus{});
+  node->mqtt.published.clear();
+  battery->monitor.loop();
+  TEST_ASSERT_EQUAL_UINT(1, node->mqtt.published.size());
+  TEST_ASSERT_EQUAL_STRING("test/bus", node->mqtt.published[0].topic.c_str());
+  return node->mqtt.published[0].payload;
+}
+
+// ids in the json plus other_frames, times the interval, gives back every frame
+static unsigned long countedFrames(const std::string& json) {
+  unsigned long tenths_per_s = 0;
+  for (size_t at = json.find(":["); at != std::string::npos; at = json.find(":[", at + 1)) {
+    char* end;
+    tenths_per_s += static_cast<unsigned long>(strtod(json.c_str() + at + 2, &end) * 10 + 0.5);
+    tenths_per_s += static_cast<unsigned long>(strtod(end + 1, nullptr) * 10 + 0.5);
+  }
+  const size_t other = json.find("\"other_frames\":");
+  TEST_ASSERT_TRUE(other != std::string::npos);
+  return tenths_per_s * bus_monitor_interval_ms / 10000UL + strtoul(json.c_str() + other + 15, nullptr, 10);
+}
+
+void setUp() {
+  fake_clock.now_us = 0;
+  node = new FakeNode();
+  battery = new Battery(node->hal, "test/");
+  battery->begin();
+  battery->connect();
+  battery->monitor.alerts(0, CanStatus{});  // starts the first interval at 0
+  node->mqtt.keep_published = true;
+}
+
+void tearDown() {
+  delete battery;
+  delete node;
+}
+
+// the fields from sof to the end of the crc, the part a transmitter stuffs
+static std::vector<bool> unstuffed(const CanFrame& frame) {
+  std::vector<bool> bits;
+  const auto put = [&](const uint32_t value, const int width) {
+    for (int i = width - 1; i >= 0; i--) {
+      bits.push_back(value >> i & 1);
+    }
+  };
+  put(0, 1);  // sof
+  if (frame.extd) {
+    put(frame.id >> 18, 11);
+    put(1, 1);  // srr
+    put(1, 1);  // ide
+    put(frame.id & 0x3FFFF, 18);
+    put(frame.rtr, 1);
+    put(0, 2);  // r1, r0
+  } else {
+    put(frame.id, 11);
+    put(frame.rtr, 1);
+    put(0, 1);  // ide
+    put(0, 1);  // r0
+  }
+  put(frame.len, 4);
+  for (uint8_t i = 0; i < frame.len && !frame.rtr; i++) {
+    put(frame.data[i], 8);
+  }
+  uint16_t crc = 0;
+  for (const bool bit : bits) {
+    const bool feedback = bit != (crc >> 14 & 1);
+    crc = static_cast<uint16_t>(crc << 1 & 0x7FFF);
+    crc ^= feedback ? 0x4599 : 0;
+  }
+  put(crc, 15);
+  return bits;
+}
+
+// what goes on the wire: a complement after every five equal bits, stuff bits count into the next run
+static std::vector<bool> stuff(const std::vector<bool>& bits) {
+  std::vector<bool> wire;
+  int run = 0;
+  for (const bool bit : bits) {
+    run = !wire.empty() && wire.back() == bit ? run + 1 : 1;
+    wire.push_back(bit);
+    if (run == 5) {
+      wire.push_back(!bit);
+      run = 1;
+    }
+  }
+  return wire;
+}
+
+// a receiver drops the bit after five equal ones, and must get the frame back
+static std::vector<bool> destuff(const std::vector<bool>& wire) {
+  std::vector<bool> bits;
+  int run = 0;
+  for (size_t i = 0; i < wire.size(); i++) {
+    run = i && wire[i] == wire[i - 1] ? run + 1 : 1;
+    bits.push_back(wire[i]);
+    if (run == 5 && ++i < wire.size()) {
+      run = 1;  // the stuff bit, skipped
+    }
+  }
+  return bits;
+}
+
+static CanFrame randomFrame(uint32_t& state) {
+  const auto next = [&state]() {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+  };
+  CanFrame frame{};
+  frame.extd = next() & 1;
+  frame.id = next() & (frame.extd ? 0x1FFFFFFF : 0x7FF);
+  frame.rtr = (next() & 7) == 0;
+  frame.len = next() % 9;
+  for (uint8_t& byte : frame.data) {
+    // runs of zeros and ones are where the stuffing happens, plain random bytes rarely have them
+    const uint32_t r = next();
+    byte = r & 0x100 ? static_cast<uint8_t>(r) : r & 0x200 ? 0x00 : 0xFF;
+  }
+  return frame;
+}
+
+// standard id 0 without data: sof, id, control and so the crc all zero, 34 zero bits with a stuff bit after every
+// five, then crc delimiter, ack, eof and intermission
+void test_frame_bits_all_zero() {
+  const CanFrame frame = {};
+  TEST_ASSERT_EQUAL_UINT16(34 + 6 + 13, BusMonitor::frameBits(frame));
+}
+
+// the reference transmitter's crc gives the published check value of crc-15/can
+void test_reference_crc() {
+  std::vector<bool> bits;
+  for (const char c : std::string("123456789")) {
+    for (int i = 7; i >= 0; i--) {
+      bits.push_back(c >> i & 1);
+    }
+  }
+  uint16_t crc = 0;
+  for (const bool bit : bits) {
+    const bool feedback = bit != (crc >> 14 & 1);
+    crc = static_cast<uint16_t>(crc << 1 & 0x7FFF);
+    crc ^= feedback ? 0x4599 : 0;
+  }
+  TEST_ASSERT_EQUAL_HEX16(0x059E, crc);
+}
+
+// random frames: the same length as a bit by bit transmitter whose stream destuffs back to the frame, and within
+// the textbook bounds, no stuffing up to the worst case of one stuff bit per four bits after the first
+void test_frame_bits_match_transmitter() {
+  uint32_t state = 2463534242U;
+  for (int round = 0; round < 20000; round++) {
+    const CanFrame frame = randomFrame(state);
+    const std::vector<bool> bits = unstuffed(frame);
+    const std::vector<bool> wire = stuff(bits);
+    TEST_ASSERT_TRUE(destuff(wire) == bits);
+    const uint16_t expected = static_cast<uint16_t>(wire.size() + 3 + 7 + 3);
+    TEST_ASSERT_EQUAL_UINT16(expected, BusMonitor::frameBits(frame));
+
+    const unsigned int data_bits = frame.rtr ? 0 : 8U * frame.len;
+    const unsigned int stuffable = (frame.extd ? 54U : 34U) + data_bits;
+    TEST_ASSERT_EQUAL_UINT(stuffable, bits.size());
+    TEST_ASSERT_GREATER_OR_EQUAL(stuffable + 13, expected);
+    TEST_ASSERT_LESS_OR_EQUAL(stuffable + 13 + (stuffable - 1) / 4, expected);
+  }
+}
+
+void test_empty_interval() {
+  const std::string json = closeInterval();
+  TEST_ASSERT_TRUE_MESSAGE(validJson(json), json.c_str());
+  TEST_ASSERT_TRUE(json.find("\"ids\":{}") != std::string::npos);
+  TEST_ASSERT_EQUAL_UINT32(0, countedFrames(json));
+}
+
+void test_standard_ids() {
+  for (uint32_t i = 0; i < 50; i++) {
+    battery->monitor.frame(BusMonitor::rx, frame(0x91, false));
+  }
+  for (uint32_t i = 0; i < 20; i++) {
+    battery->monitor.frame(BusMonitor::tx, frame(0x110, false));
+  }
+  const std::string json = closeInterval();
+  TEST_ASSERT_TRUE_MESSAGE(validJson(json), json.c_str());
+  TEST_ASSERT_TRUE(json.find("\"091\":[5.0,0.0],\"110\":[0.0,2.0]") != std::string::npos);
+  TEST_ASSERT_EQUAL_UINT32(70, countedFrames(json));
+}
+
+// every counter slot taken by an extended id plus ids beyond the table, with error counters at their widest: the
+// longest summary the monitor can be asked for stays complete json and accounts for every frame
+void test_full_table_stays_valid_json() {
+  uint32_t total = 0;
+  for (uint32_t i = 0; i < bus_monitor_ids + 4; i++) {
+    for (uint32_t n = 0; n < 20000 + i * 100; n++) {
+      battery->monitor.frame(BusMonitor::rx, frame(0x18FF0000 + i, true));
+      battery->monitor.frame(BusMonitor::tx, frame(0x18FF0000 + i, true));
+      total += 2;
+    }
+  }
+  fake_clock.advanceMillis(bus_monitor_interval_ms);
+  CanStatus status{};
+  status.bus_error_count = status.rx_missed_count = status.rx_overrun_count = 4000000000U;
+  battery->monitor.alerts(CAN_ALERT_ERR_PASS, status);
+  node->mqtt.published.clear();
+  battery->monitor.loop();
+  TEST_ASSERT_EQUAL_UINT(1, node->mqtt.published.size());
+  const std::string& json = node->mqtt.published[0].payload;
+  TEST_ASSERT_TRUE_MESSAGE(validJson(json), json.c_str());
+  TEST_ASSERT_LESS_THAN(768, json.size());
+  TEST_ASSERT_TRUE(json.find("\"alarms\":\"errors,load\"") != std::string::npos);
+  TEST_ASSERT_EQUAL_UINT32(total, countedFrames(json));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_bits_all_zero);
+  RUN_TEST(test_reference_crc);
+  RUN_TEST(test_frame_bits_match_transmitter);
+  RUN_TEST(test_empty_interval);
+  RUN_TEST(test_standard_ids);
+  RUN_TEST(test_full_table_stays_valid_json);
+  return UNITY_END();
+}
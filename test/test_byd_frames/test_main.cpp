@@ -0,0 +1,199 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "battery.h"
+#include "byd_frames.h"
+#include "fake_hal.h"
+
+// every byd_frames.h signal goes through encode and decode, including the signed, scaled and edge values a
+// change of raw type or scale would break
+
+static FakeNode* node;
+static Battery* battery;
+
+void setUp() {
+  node = new FakeNode();
+  battery = new Battery(node->hal, "test");
+}
+
+void tearDown() {
+  delete battery;
+  delete node;
+}
+
+template <typename Frame>
+static void roundTrip(CanManager& source, CanManager& target, uint8_t* data) {
+  memset(data, 0, 8);
+  Frame::encode(source, data);
+  Frame::decode(target, data);
+}
+
+static uint16_t word(const uint8_t* data, const size_t offset) {
+  return static_cast<uint16_t>(data[offset] << 8 | data[offset + 1]);
+}
+
+void test_limits_frame() {
+  FakeNode other_node;
+  Battery other(other_node.hal, "other");
+  CanManager& can = battery->can;
+  can.limit_battery_voltage_max = 230.0f;
+  can.limit_battery_voltage_min = 170.0f;
+  can.effective_discharge_current_max = 25.6f;
+  can.effective_charge_current_max = 6553.5f;
+  uint8_t data[8];
+  roundTrip<LimitsFrame>(can, other.can, data);
+  TEST_ASSERT_EQUAL_UINT32(0x110, LimitsFrame::id);
+  TEST_ASSERT_EQUAL_UINT16(2300, word(data, 0));
+  TEST_ASSERT_EQUAL_UINT16(1700, word(data, 2));
+  TEST_ASSERT_EQUAL_UINT16(256, word(data, 4));
+  TEST_ASSERT_EQUAL_UINT16(0xFFFF, word(data, 6));
+  TEST_ASSERT_EQUAL_FLOAT(230.0f, other.can.limit_battery_voltage_max);
+  TEST_ASSERT_EQUAL_FLOAT(170.0f, other.can.limit_battery_voltage_min);
+  TEST_ASSERT_EQUAL_FLOAT(25.6f, other.can.effective_discharge_current_max);
+  TEST_ASSERT_EQUAL_FLOAT(6553.5f, other.can.effective_charge_current_max);
+}
+
+void test_battery_info_frame_signed() {
+  FakeNode other_node;
+  Battery other(other_node.hal, "other");
+  CanManager& can = battery->can;
+  can.battery_voltage = 215.0f;
+  can.battery_current = -4.3f;
+  can.battery_temp = -3276.8f;
+  uint8_t data[8];
+  roundTrip<BatteryInfoFrame>(can, other.can, data);
+  TEST_ASSERT_EQUAL_UINT16(2150, word(data, 0));
+  TEST_ASSERT_EQUAL_UINT16(0xFFD5, word(data, 2));
+  TEST_ASSERT_EQUAL_UINT16(0x8000, word(data, 4));
+  TEST_ASSERT_EQUAL_UINT16(776, word(data, 6));  // constant status bytes
+  TEST_ASSERT_EQUAL_FLOAT(215.0f, other.can.battery_voltage);
+  TEST_ASSERT_EQUAL_FLOAT(-4.3f, other.can.battery_current);
+  TEST_ASSERT_EQUAL_FLOAT(-3276.8f, other.can.battery_temp);
+}
+
+void test_cell_info_frame() {
+  FakeNode other_node;
+  Battery other(other_node.hal, "other");
+  CanManager& can = battery->can;
+  can.cell_temp_max = 23.0f;
+  can.cell_temp_min = 0.1f;
+  uint8_t data[8];
+  roundTrip<CellInfoFrame>(can, other.can, data);
+  TEST_ASSERT_EQUAL_UINT16(230, word(data, 0));
+  TEST_ASSERT_EQUAL_UINT16(1, word(data, 2));
+  TEST_ASSERT_EQUAL_FLOAT(23.0f, other.can.cell_temp_max);
+  TEST_ASSERT_EQUAL_FLOAT(0.1f, other.can.cell_temp_min);
+}
+
+void test_states_frame_scaled() {
+  FakeNode other_node;
+  Battery other(other_node.hal, "other");
+  CanManager& can = battery->can;
+  can.soc_percent = 0.53f;  // 0.53 * 100 is 52.99998 in float
+  can.soh_percent = 100.0f;
+  can.remaining_capacity_ah = 28.7f;
+  can.full_capacity_ah = 100.0f;
+  uint8_t data[8];
+  roundTrip<StatesFrame>(can, other.can, data);
+  TEST_ASSERT_EQUAL_UINT16(53, word(data, 0));
+  TEST_ASSERT_EQUAL_UINT16(10000, word(data, 2));
+  TEST_ASSERT_EQUAL_UINT16(287, word(data, 4));
+  TEST_ASSERT_EQUAL_UINT16(1000, word(data, 6));
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 0.53f, other.can.soc_percent);
+  TEST_ASSERT_EQUAL_FLOAT(100.0f, other.can.soh_percent);
+  TEST_ASSERT_FLOAT_WITHIN(0.001f, 28.7f, other.can.remaining_capacity_ah);
+  TEST_ASSERT_EQUAL_FLOAT(100.0f, other.can.full_capacity_ah);
+}
+
+void test_every_raw_value_survives_decode_and_encode() {
+  CanManager& can = battery->can;
+  uint8_t data[8]{};
+  uint8_t again[8]{};
+  for (uint32_t raw = 0; raw <= 0xFFFF; raw++) {
+    for (size_t offset = 0; offset < 8; offset += 2) {
+      data[offset] = raw >> 8;
+      data[offset + 1] = raw & 0xFF;
+    }
+    StatesFrame::decode(can, data);
+    StatesFrame::encode(can, again);
+    TEST_ASSERT_EQUAL_MEMORY(data, again, 8);
+    InverterBatteryFrame::decode(can, data);
+    memset(again, 0, sizeof(again));
+    InverterBatteryFrame::encode(can, again);
+    TEST_ASSERT_EQUAL_MEMORY(data, again, 6);
+    BatteryInfoFrame::decode(can, data);
+    BatteryInfoFrame::encode(can, again);
+    TEST_ASSERT_EQUAL_MEMORY(data, again, 6);
+  }
+}
+
+void test_out_of_range_values_saturate() {
+  FakeNode other_node;
+  Battery other(other_node.hal, "other");
+  CanManager& can = battery->can;
+  can.limit_battery_voltage_max = 7000.0f;
+  can.limit_battery_voltage_min = -1.0f;
+  can.effective_discharge_current_max = std::numeric_limits<float>::quiet_NaN();
+  can.effective_charge_current_max = 6553.56f;
+  uint8_t data[8];
+  roundTrip<LimitsFrame>(can, other.can, data);
+  TEST_ASSERT_EQUAL_UINT16(0xFFFF, word(data, 0));
+  TEST_ASSERT_EQUAL_UINT16(0, word(data, 2));
+  TEST_ASSERT_EQUAL_UINT16(0, word(data, 4));
+  TEST_ASSERT_EQUAL_UINT16(0xFFFF, word(data, 6));
+
+  can.battery_voltage = 4000.0f;
+  can.battery_current = -4000.0f;
+  can.battery_temp = -0.04f;
+  roundTrip<BatteryInfoFrame>(can, other.can, data);
+  TEST_ASSERT_EQUAL_UINT16(0x7FFF, word(data, 0));
+  TEST_ASSERT_EQUAL_UINT16(0x8000, word(data, 2));
+  TEST_ASSERT_EQUAL_UINT16(0, word(data, 4));
+  TEST_ASSERT_EQUAL_FLOAT(3276.7f, other.can.battery_voltage);
+  TEST_ASSERT_EQUAL_FLOAT(-3276.8f, other.can.battery_current);
+}
+
+void test_inverter_battery_frame() {
+  FakeNode other_node;
+  Battery other(other_node.hal, "other");
+  const uint8_t data[8] = {0x08, 0x66, 0xFF, 0x9C, 0x00, 0xDC, 0xAA, 0xBB};  // 215.0V, -10.0A, 22.0°C
+  InverterBatteryFrame::decode(other.can, data);
+  TEST_ASSERT_EQUAL_FLOAT(215.0f, other.can.inverter_battery_voltage);
+  TEST_ASSERT_EQUAL_FLOAT(-10.0f, other.can.inverter_battery_current);
+  TEST_ASSERT_EQUAL_FLOAT(22.0f, other.can.inverter_temperature);
+  uint8_t again[8]{};
+  InverterBatteryFrame::encode(other.can, again);
+  TEST_ASSERT_EQUAL_MEMORY(data, again, 6);
+  TEST_ASSERT_EQUAL_UINT8(0, again[6]);  // bytes outside the layout are left alone
+}
+
+void test_inverter_soc_and_timestamp_frames() {
+  FakeNode other_node;
+  Battery other(other_node.hal, "other");
+  const uint8_t soc[8] = {0x03, 0x20};
+  InverterSocFrame::decode(other.can, soc);
+  TEST_ASSERT_EQUAL_FLOAT(80.0f, other.can.inverter_soc);
+
+  const uint8_t timestamp[8] = {0xDE, 0xAD, 0xBE, 0xEF};
+  InverterTimestampFrame::decode(other.can, timestamp);
+  TEST_ASSERT_EQUAL_HEX32(0xDEADBEEF, other.can.inverter_timestamp);
+  uint8_t again[8]{};
+  InverterTimestampFrame::encode(other.can, again);
+  TEST_ASSERT_EQUAL_MEMORY(timestamp, again, 4);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_limits_frame);
+  RUN_TEST(test_battery_info_frame_signed);
+  RUN_TEST(test_cell_info_frame);
+  RUN_TEST(test_states_frame_scaled);
+  RUN_TEST(test_every_raw_value_survives_decode_and_encode);
+  RUN_TEST(test_out_of_range_values_saturate);
+  RUN_TEST(test_inverter_battery_frame);
+  RUN_TEST(test_inverter_soc_and_timestamp_frames);
+  return UNITY_END();
+}
@@ -0,0 +1,156 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <cstdio>
+
+#include "battery.h"
+#include "can_dispatch.h"
+#include "fake_hal.h"
+
+// the dispatcher table and the TWAI acceptance filter it derives from the registered ids
+
+struct Context {
+  unsigned int calls = 0;
+};
+
+using Dispatcher = CanDispatcher<16, Context>;
+
+static void handlerA(Context& context, const CanFrame&) { context.calls += 1; }
+static void handlerB(Context& context, const CanFrame&) { context.calls += 100; }
+
+static uint32_t random_state;
+static uint32_t next() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+static CanFrame frame(const uint32_t id, const bool extd = false, const bool rtr = false, const uint8_t data0 = 0) {
+  CanFrame frame{};
+  frame.id = id;
+  frame.extd = extd;
+  frame.rtr = rtr;
+  frame.len = rtr ? 0 : 8;
+  frame.data[0] = data0;
+  frame.data[1] = 0x5A;
+  return frame;
+}
+
+// standard ids the filter lets through, rtr and data bytes must not matter
+static unsigned int acceptedIds(const CanFilter& filter) {
+  unsigned int accepted = 0;
+  for (uint32_t id = 0; id < 0x800; id++) {
+    accepted += canFilterAccepts(filter, frame(id));
+  }
+  return accepted;
+}
+
+void setUp() { random_state = 88172645U; }
+
+void tearDown() {}
+
+void test_find_add_and_overwrite() {
+  Dispatcher dispatcher;
+  Context context;
+  TEST_ASSERT_TRUE(dispatcher.add(0x91, handlerA));
+  TEST_ASSERT_TRUE(dispatcher.add(0x91 | can_dispatch_extended, handlerB));
+  TEST_ASSERT_TRUE(dispatcher.find(0x91) == handlerA);
+  TEST_ASSERT_TRUE(dispatcher.find(0x91 | can_dispatch_extended) == handlerB);
+  TEST_ASSERT_NULL(dispatcher.find(0x92));
+  TEST_ASSERT_TRUE(dispatcher.add(0x91, handlerB));  // same key replaces, does not take a second slot
+  dispatcher.find(0x91)(context, frame(0x91));
+  TEST_ASSERT_EQUAL_UINT(100, context.calls);
+}
+
+void test_table_stops_at_half_full() {
+  Dispatcher dispatcher;
+  for (uint32_t id = 0; id < 8; id++) {
+    TEST_ASSERT_TRUE(dispatcher.add(0x100 + id * 0x10, handlerA));
+  }
+  TEST_ASSERT_FALSE(dispatcher.add(0x700, handlerA));
+  TEST_ASSERT_NULL(dispatcher.find(0x700));
+  for (uint32_t id = 0; id < 8; id++) {
+    TEST_ASSERT_TRUE(dispatcher.find(0x100 + id * 0x10) == handlerA);
+  }
+}
+
+void test_filter_accepts_all_without_standard_ids() {
+  Dispatcher empty;
+  CanFilter filter = empty.filter();
+  TEST_ASSERT_EQUAL_UINT(0x800, acceptedIds(filter));
+
+  Dispatcher extended;
+  extended.add(0x91, handlerA);
+  extended.add(0x18FF50E5 | can_dispatch_extended, handlerA);
+  filter = extended.filter();
+  TEST_ASSERT_TRUE(canFilterAccepts(filter, frame(0x18FF50E5, true)));
+  TEST_ASSERT_EQUAL_UINT(0x800, acceptedIds(filter));
+}
+
+// random id sets up to the table limit: every registered id passes with any rtr bit and data, the filter is never
+// wider than one single mode filter over all ids, and a lone id gets an exact match
+void test_filter_accepts_every_registered_id() {
+  for (unsigned int round = 0; round < 300; round++) {
+    Dispatcher dispatcher;
+    uint32_t ids[8];
+    const unsigned int n = 1 + round % 8;
+    uint32_t all_and = 0x7FF, all_or = 0;
+    for (unsigned int i = 0; i < n; i++) {
+      ids[i] = next() & 0x7FF;
+      all_and &= ids[i];
+      all_or |= ids[i];
+      TEST_ASSERT_TRUE(dispatcher.add(ids[i], handlerA));
+    }
+    const CanFilter filter = dispatcher.filter();
+    for (unsigned int i = 0; i < n; i++) {
+      char message[48];
+      snprintf(message, sizeof(message), "round %u id %03lx", round, static_cast<unsigned long>(ids[i]));
+      TEST_ASSERT_TRUE_MESSAGE(canFilterAccepts(filter, frame(ids[i])), message);
+      TEST_ASSERT_TRUE_MESSAGE(canFilterAccepts(filter, frame(ids[i], false, true)), message);
+      TEST_ASSERT_TRUE_MESSAGE(canFilterAccepts(filter, frame(ids[i], false, false, 0xFF)), message);
+    }
+    const unsigned int accepted = acceptedIds(filter);
+    TEST_ASSERT_LESS_OR_EQUAL(1U << __builtin_popcount(all_and ^ all_or), accepted);
+    if (n == 1) {
+      TEST_ASSERT_EQUAL_UINT(1, accepted);
+    }
+  }
+}
+
+void test_dual_filter_for_two_distant_ids() {
+  Dispatcher dispatcher;
+  dispatcher.add(0x000, handlerA);
+  dispatcher.add(0x7FF, handlerA);  // one single filter would have to accept everything
+  const CanFilter filter = dispatcher.filter();
+  TEST_ASSERT_FALSE(filter.single_filter);
+  TEST_ASSERT_EQUAL_UINT(2, acceptedIds(filter));
+}
+
+// the battery's own table: the inverter frames get through the fake driver, unrelated traffic does not
+void test_battery_filter_in_the_driver() {
+  FakeNode node;
+  Battery battery(node.hal, "test/");
+  battery.begin();
+  const uint32_t handled[] = {0x91, 0xd1, 0x111, 0x151};
+  for (const uint32_t id : handled) {
+    node.can.inject(frame(id));
+  }
+  TEST_ASSERT_EQUAL_UINT(4, node.can.rx.size());
+  TEST_ASSERT_EQUAL_UINT(0, node.can.filtered_count);
+  const unsigned int accepted = acceptedIds(node.can.filter);
+  TEST_ASSERT_LESS_THAN(0x800 / 8, accepted);
+  node.can.inject(frame(0x18FF50E5, true));
+  TEST_ASSERT_EQUAL_UINT(1, node.can.filtered_count);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_find_add_and_overwrite);
+  RUN_TEST(test_table_stops_at_half_full);
+  RUN_TEST(test_filter_accepts_all_without_standard_ids);
+  RUN_TEST(test_filter_accepts_every_registered_id);
+  RUN_TEST(test_dual_filter_for_two_distant_ids);
+  RUN_TEST(test_battery_filter_in_the_driver);
+  return UNITY_END();
+}
@@ -0,0 +1,114 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "battery.h"
+#include "can_trace.h"
+#include "fake_hal.h"
+
+// candump notation: formatFrame and parseFrame round trip, and every malformed text is rejected, and a capture
+// holds the frames that made it onto the bus, not every attempt
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_round_trip() {
+  for (uint8_t len = 0; len <= 8; len++) {
+    for (const bool extd : {false, true}) {
+      CanFrame frame{};
+      frame.id = extd ? 0x18FF50E5 : 0x7A1;
+      frame.extd = extd;
+      frame.len = len;
+      for (uint8_t i = 0; i < len; i++) {
+        frame.data[i] = static_cast<uint8_t>(0xF0 + i * 3);
+      }
+      char text[32];
+      formatFrame(frame, text, sizeof(text));
+      CanFrame parsed{};
+      TEST_ASSERT_TRUE_MESSAGE(parseFrame(text, parsed), text);
+      TEST_ASSERT_EQUAL_HEX32(frame.id, parsed.id);
+      TEST_ASSERT_EQUAL(frame.extd, parsed.extd);
+      TEST_ASSERT_EQUAL_UINT8(len, parsed.len);
+      TEST_ASSERT_EQUAL_MEMORY(frame.data, parsed.data, 8);
+    }
+  }
+}
+
+void test_remote_request_and_separators() {
+  CanFrame frame{};
+  TEST_ASSERT_TRUE(parseFrame("151#R", frame));
+  TEST_ASSERT_TRUE(frame.rtr);
+  TEST_ASSERT_EQUAL_UINT8(0, frame.len);
+  TEST_ASSERT_TRUE(parseFrame("091#08.66.ff.9c", frame));
+  TEST_ASSERT_EQUAL_UINT8(4, frame.len);
+  TEST_ASSERT_EQUAL_HEX8(0x9C, frame.data[3]);
+  TEST_ASSERT_TRUE(parseFrame("091#", frame));  // zero length data frame
+  TEST_ASSERT_EQUAL_UINT8(0, frame.len);
+  TEST_ASSERT_FALSE(frame.rtr);
+  TEST_ASSERT_TRUE(parseFrame("091#0866\r\n", frame));
+  TEST_ASSERT_EQUAL_UINT8(2, frame.len);
+}
+
+void test_malformed_text_is_rejected() {
+  static const char* const malformed[] = {
+      "123#GG", "123#0G", "123#1", "123#012", "123#001122334455667788", "123#R1", "#00", "12G#00", "123456789#",
+      "12300", "123#00 x", "123#00#11", "",
+  };
+  for (const char* text : malformed) {
+    CanFrame frame{};
+    TEST_ASSERT_FALSE_MESSAGE(parseFrame(text, frame), text);
+  }
+}
+
+static void run(Battery& battery, const unsigned long ms) {
+  for (unsigned long i = 0; i < ms; i++) {
+    battery.loop();
+    fake_clock.advanceMillis(1);
+  }
+}
+
+// tx lines of a candump dump of the capture
+static unsigned int capturedTx(FakeNode& node, Battery& battery) {
+  node.mqtt.published.clear();
+  node.mqtt.deliver("test/trace", "candump");
+  run(battery, can_capture_size / can_capture_dump_per_poll + 10);
+  unsigned int lines = 0;
+  for (const auto& message : node.mqtt.published) {
+    lines += message.topic == "test/candump" && message.payload.find(") tx ") != std::string::npos;
+  }
+  return lines;
+}
+
+// attempts nobody acked are retried and dropped, none of them is a frame in the capture
+void test_capture_has_only_sent_frames() {
+  fake_clock.now_us = 0;
+  FakeNode node;
+  node.mqtt.keep_published = true;
+  node.can.no_ack = true;
+  Battery battery(node.hal, "test/");
+  battery.begin();
+  battery.connect();
+  run(battery, 3000);
+  TEST_ASSERT_GREATER_THAN(0, battery.bus.txStats().failed_attempts);
+  TEST_ASSERT_GREATER_THAN(0, battery.bus.txStats().dropped_attempts);  // the backoff ends well before the deadline
+  TEST_ASSERT_EQUAL_UINT32(0, battery.bus.txStats().dropped_stale);
+  TEST_ASSERT_EQUAL_UINT(0, capturedTx(node, battery));
+
+  node.can.no_ack = false;
+  run(battery, 3000);
+  const auto sent = static_cast<unsigned int>(node.can.tx_count);  // the dump only covers what is captured now
+  TEST_ASSERT_GREATER_THAN(0, sent);
+  TEST_ASSERT_EQUAL_UINT(sent, capturedTx(node, battery));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_round_trip);
+  RUN_TEST(test_remote_request_and_separators);
+  RUN_TEST(test_malformed_text_is_rejected);
+  RUN_TEST(test_capture_has_only_sent_frames);
+  return UNITY_END();
+}
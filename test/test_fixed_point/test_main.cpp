@@ -0,0 +1,146 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "fixed_point.h"
+
+// integer-only decimal formatting and parsing: rounding, int32 limits and agreement with printf
+
+void setUp() {}
+
+void tearDown() {}
+
+static void assertFormat(const char* expected, const int32_t scaled, const uint8_t decimals) {
+  char buf[24];
+  const size_t length = formatFixed(scaled, decimals, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_STRING(expected, buf);
+  TEST_ASSERT_EQUAL_UINT(strlen(expected), length);
+}
+
+static void assertParse(const char* text, const uint8_t decimals, const int32_t expected) {
+  int32_t scaled = 0;
+  TEST_ASSERT_TRUE_MESSAGE(parseFixed(text, decimals, scaled), text);
+  TEST_ASSERT_EQUAL_INT32(expected, scaled);
+}
+
+void test_format() {
+  assertFormat("0", 0, 0);
+  assertFormat("0.0", 0, 1);
+  assertFormat("215.3", 2153, 1);
+  assertFormat("-0.05", -5, 2);
+  assertFormat("0.007", 7, 3);
+  assertFormat("2147483647", INT32_MAX, 0);
+  assertFormat("-2147483648", INT32_MIN, 0);
+  assertFormat("-21474836.48", INT32_MIN, 2);
+  assertFormat("-0.000000001", -1, 9);
+}
+
+void test_format_buffer_too_small() {
+  char buf[6];
+  TEST_ASSERT_EQUAL_UINT(5, formatFixed(-123, 1, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_STRING("-12.3", buf);
+  TEST_ASSERT_EQUAL_UINT(0, formatFixed(-1234, 1, buf, sizeof(buf)));  // "-123.4" needs 7 with the zero
+  TEST_ASSERT_EQUAL_STRING("", buf);
+  TEST_ASSERT_EQUAL_UINT(0, formatFixed(0, 0, buf, 0));
+}
+
+// every value at every resolution the telemetry uses prints like printf of the exact quotient
+void test_format_matches_printf() {
+  for (int32_t scaled = -20000; scaled <= 20000; scaled += 7) {
+    for (uint8_t decimals = 0; decimals <= 3; decimals++) {
+      const int32_t scale = static_cast<int32_t>(decimalScale(decimals));
+      char expected[24];
+      if (decimals == 0) {
+        snprintf(expected, sizeof(expected), "%ld", static_cast<long>(scaled));
+      } else {
+        snprintf(expected, sizeof(expected), "%s%ld.%0*ld", scaled < 0 ? "-" : "", labs(scaled) / scale,
+                 static_cast<int>(decimals), labs(scaled) % scale);
+      }
+      assertFormat(expected, scaled, decimals);
+    }
+  }
+}
+
+void test_to_scaled_rounds_and_clamps() {
+  TEST_ASSERT_EQUAL_INT32(53, toScaled(0.53f, 2));
+  TEST_ASSERT_EQUAL_INT32(-43, toScaled(-4.25f, 1));  // half away from zero
+  TEST_ASSERT_EQUAL_INT32(43, toScaled(4.25f, 1));
+  TEST_ASSERT_EQUAL_INT32(0, toScaled(-0.04f, 1));
+  TEST_ASSERT_EQUAL_INT32(INT32_MAX, toScaled(3e9f, 0));
+  TEST_ASSERT_EQUAL_INT32(INT32_MIN, toScaled(-3e9f, 0));
+  TEST_ASSERT_EQUAL_INT32(INT32_MAX, toScaled(1e30f, 2));
+}
+
+void test_parse() {
+  assertParse("12.5", 1, 125);
+  assertParse("12.5", 2, 1250);
+  assertParse("+7", 0, 7);
+  assertParse("-0.5", 1, -5);
+  assertParse(".5", 1, 5);
+  assertParse("5.", 1, 50);
+  assertParse("007", 0, 7);
+  assertParse("25.6", 0, 26);
+}
+
+void test_parse_rounds_half_away_from_zero() {
+  assertParse("0.05", 1, 1);
+  assertParse("0.0499", 1, 0);
+  assertParse("-0.05", 1, -1);
+  assertParse("-0.0499", 1, 0);
+  assertParse("1.23456789", 3, 1235);
+  assertParse("2.5", 0, 3);
+  assertParse("-2.5", 0, -3);
+}
+
+void test_parse_limits() {
+  assertParse("2147483647", 0, INT32_MAX);
+  assertParse("-2147483648", 0, INT32_MIN);
+  assertParse("21474836.47", 2, INT32_MAX);
+  assertParse("-21474836.48", 2, INT32_MIN);
+  int32_t scaled = 42;
+  TEST_ASSERT_FALSE(parseFixed("2147483648", 0, scaled));
+  TEST_ASSERT_FALSE(parseFixed("-2147483649", 0, scaled));
+  TEST_ASSERT_FALSE(parseFixed("21474836.48", 2, scaled));
+  TEST_ASSERT_FALSE(parseFixed("2147483647.5", 0, scaled));  // rounds past the limit
+  TEST_ASSERT_FALSE(parseFixed("99999999999999999999", 0, scaled));
+  TEST_ASSERT_EQUAL_INT32(42, scaled);  // untouched on failure
+}
+
+void test_parse_rejects_malformed() {
+  static const char* const malformed[] = {"", "-", "+", ".", "-.", "1.2.3", "1e3", " 1", "1 ", "0x10", "1,5", "--1",
+                                          "nan"};
+  for (const char* text : malformed) {
+    int32_t scaled;
+    TEST_ASSERT_FALSE_MESSAGE(parseFixed(text, 2, scaled), text);
+  }
+}
+
+// format then parse gives the value back, at every resolution
+void test_round_trip() {
+  for (int32_t scaled = -100000; scaled <= 100000; scaled += 13) {
+    for (uint8_t decimals = 0; decimals <= 4; decimals++) {
+      char buf[24];
+      formatFixed(scaled, decimals, buf, sizeof(buf));
+      int32_t parsed = 0;
+      TEST_ASSERT_TRUE_MESSAGE(parseFixed(buf, decimals, parsed), buf);
+      TEST_ASSERT_EQUAL_INT32(scaled, parsed);
+    }
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_format);
+  RUN_TEST(test_format_buffer_too_small);
+  RUN_TEST(test_format_matches_printf);
+  RUN_TEST(test_to_scaled_rounds_and_clamps);
+  RUN_TEST(test_parse);
+  RUN_TEST(test_parse_rounds_half_away_from_zero);
+  RUN_TEST(test_parse_limits);
+  RUN_TEST(test_parse_rejects_malformed);
+  RUN_TEST(test_round_trip);
+  return UNITY_END();
+}
@@ -0,0 +1,169 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "battery.h"
+#include "fake_hal.h"
+#include "frame_scheduler.h"
+
+// reconfiguring a periodic frame over mqtt: the period has a floor and the task's counters survive, and on a battery
+// a limit change or heartbeat loss puts 0x110 on the bus right away, spaced by can_trigger_min_spacing_ms
+
+static unsigned int sends;
+
+static void send(void*, bool, unsigned long) { sends++; }
+
+static FrameScheduler* scheduler;
+
+void setUp() {
+  sends = 0;
+  scheduler = new FrameScheduler();
+  scheduler->add(0x110, send, nullptr, 2000UL);
+  scheduler->start(0);
+}
+
+void tearDown() { delete scheduler; }
+
+static void runUntil(unsigned long& now_us, const unsigned long end_us) {
+  for (; now_us <= end_us; now_us += 1000UL) {
+    scheduler->run(now_us);
+  }
+}
+
+void test_periods_below_the_floor_are_rejected() {
+  TEST_ASSERT_FALSE(scheduler->configure(0x110, 0));
+  TEST_ASSERT_FALSE(scheduler->configure(0x110, 1));
+  TEST_ASSERT_FALSE(scheduler->configure(0x110, can_schedule_min_period_ms - 1));
+  TEST_ASSERT_TRUE(scheduler->configure(0x110, can_schedule_min_period_ms));
+  TEST_ASSERT_FALSE(scheduler->configure(0x111, 1000UL));  // not scheduled
+}
+
+void test_counters_survive_reconfiguration() {
+  unsigned long now_us = 0;
+  runUntil(now_us, 10UL * 1000UL * 1000UL);
+  scheduler->trigger(0x110, now_us);
+  runUntil(now_us, 10UL * 1000UL * 1000UL + 500UL * 1000UL);
+  const ScheduleStats before = scheduler->find(0x110)->stats;
+  TEST_ASSERT_EQUAL_UINT32(6, before.runs);  // 0, 2, ... 10 s
+  TEST_ASSERT_EQUAL_UINT32(1, before.triggered);
+
+  TEST_ASSERT_TRUE(scheduler->configure(0x110, 500UL));
+  runUntil(now_us, 12UL * 1000UL * 1000UL);
+  const ScheduleStats& after = scheduler->find(0x110)->stats;
+  TEST_ASSERT_EQUAL_UINT32(1, after.triggered);
+  TEST_ASSERT_EQUAL_UINT32(before.runs + 3, after.runs);  // 11, 11.5, 12 s on the new grid
+  TEST_ASSERT_EQUAL_UINT32(before.skipped, after.skipped);
+
+  TEST_ASSERT_TRUE(scheduler->reset(0x110));
+  runUntil(now_us, 14UL * 1000UL * 1000UL);
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler->find(0x110)->stats.triggered);
+  TEST_ASSERT_EQUAL_UINT32(before.runs + 4, scheduler->find(0x110)->stats.runs);  // 14 s
+  TEST_ASSERT_EQUAL_UINT(sends, before.runs + 1 + 4);
+}
+
+struct Sent {
+  unsigned long ms;
+  float charge_current_max;
+};
+
+// a battery on the fake bus, every 0x110 it sends noted with the millisecond it went out in
+struct Node {
+  FakeNode node;
+  Battery battery{node.hal, "test/"};
+  std::vector<Sent> limits;
+
+  Node() {
+    fake_clock.now_us = 0;
+    node.can.keep_tx = true;
+    battery.begin();
+    battery.connect();
+  }
+  void run(const unsigned long ms) {
+    for (unsigned long i = 0; i < ms; i++) {
+      battery.loop();
+      for (const CanFrame& frame : node.can.tx) {
+        if (frame.id == 0x110) {
+          limits.push_back({fake_clock.millis(), static_cast<float>(frame.data[6] << 8 | frame.data[7]) / 10});
+        }
+      }
+      node.can.tx.clear();
+      fake_clock.advanceMillis(1);
+    }
+  }
+  // 0x110s sent from ms on
+  std::vector<Sent> since(const unsigned long ms) const {
+    std::vector<Sent> found;
+    for (const Sent& sent : limits) {
+      if (sent.ms >= ms) {
+        found.push_back(sent);
+      }
+    }
+    return found;
+  }
+};
+
+// a set between two slots goes out in the same loop pass, not up to 2 s later on the grid
+void test_limit_set_is_sent_at_once() {
+  Node node;
+  node.run(4500);
+  const uint32_t urgent_before = node.battery.bus.txStats().urgent_sent;
+  const unsigned long set_ms = fake_clock.millis();
+  node.node.mqtt.deliver("test/limits/max_charge_current/set", "12.5");
+  node.run(5);
+  const std::vector<Sent> sent = node.since(set_ms);
+  TEST_ASSERT_EQUAL_UINT(1, sent.size());
+  TEST_ASSERT_EQUAL_UINT32(set_ms, sent[0].ms);
+  TEST_ASSERT_EQUAL_FLOAT(12.5f, sent[0].charge_current_max);
+  TEST_ASSERT_EQUAL_UINT32(urgent_before + 1, node.battery.bus.txStats().urgent_sent);
+  TEST_ASSERT_GREATER_THAN(0, node.battery.bus.txStats().urgent_latency_max_us);
+  TEST_ASSERT_LESS_OR_EQUAL(2000, node.battery.bus.txStats().urgent_latency_max_us);  // the tx success alert
+}
+
+// a set every 20 ms: out of cycle sends at most every can_trigger_min_spacing_ms, the last value not held back
+void test_burst_is_spaced() {
+  Node node;
+  node.run(4500);
+  const unsigned long first_ms = fake_clock.millis();
+  for (int i = 1; i <= 20; i++) {
+    char payload[8];
+    snprintf(payload, sizeof(payload), "%d", i);
+    node.node.mqtt.deliver("test/limits/max_charge_current/set", payload);
+    node.run(20);
+  }
+  const unsigned long last_ms = fake_clock.millis() - 20;
+  node.run(can_trigger_min_spacing_ms);
+  const std::vector<Sent> sent = node.since(first_ms);
+  TEST_ASSERT_GREATER_OR_EQUAL(4, sent.size());
+  TEST_ASSERT_LESS_OR_EQUAL(400 / can_trigger_min_spacing_ms + 2, sent.size());
+  for (size_t i = 1; i < sent.size(); i++) {
+    TEST_ASSERT_GREATER_OR_EQUAL(can_trigger_min_spacing_ms, sent[i].ms - sent[i - 1].ms);
+  }
+  TEST_ASSERT_EQUAL_FLOAT(20.0f, sent.back().charge_current_max);
+  TEST_ASSERT_LESS_OR_EQUAL(last_ms + can_trigger_min_spacing_ms, sent.back().ms);
+}
+
+// without a master heartbeat for heartbeat_timeout_limits_ms the zeroed limits go out at once
+void test_heartbeat_loss_zeroes_limits_at_once() {
+  Node node;
+  node.run(1333);  // the last heartbeat off the 0x110 grid, so the loss is too
+  node.node.mqtt.deliver(mqtt_master_heartbeat_topic, "1");
+  const unsigned long lost_ms = fake_clock.millis() + heartbeat_timeout_limits_ms;
+  node.run(heartbeat_timeout_limits_ms);
+  TEST_ASSERT_GREATER_THAN(0.0f, node.limits.back().charge_current_max);
+  node.run(5);
+  const std::vector<Sent> sent = node.since(lost_ms);
+  TEST_ASSERT_EQUAL_UINT(1, sent.size());
+  TEST_ASSERT_EQUAL_UINT32(lost_ms, sent[0].ms);
+  TEST_ASSERT_EQUAL_FLOAT(0.0f, sent[0].charge_current_max);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_periods_below_the_floor_are_rejected);
+  RUN_TEST(test_counters_survive_reconfiguration);
+  RUN_TEST(test_limit_set_is_sent_at_once);
+  RUN_TEST(test_burst_is_spaced);
+  RUN_TEST(test_heartbeat_loss_zeroes_limits_at_once);
+  return UNITY_END();
+}
@@ -0,0 +1,227 @@
+#include <unity.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <string>
+
+#include "main_vars.h"
+#include "mqtt_queue.h"
+
+// MqttSendQueue against the std::multiset queue it replaced: same order, same evictions, and a timing run of both
+
+namespace {
+
+// the previous implementation, kept as the reference
+class MultisetQueue {
+ public:
+  struct QueuedMessage {
+    std::string topic;
+    std::string payload;
+    bool retain;
+    int priority;
+  };
+
+  void push(const char* prefix, const char* topic, const char* payload, const bool retain, const int priority) {
+    const QueuedMessage msg{std::string(prefix) + topic, payload, retain, priority};
+    if (messages.size() >= max_mqtt_send_queue) {
+      if (const auto it = --messages.end(); priority > it->priority) {
+        messages.erase(it);  // delete lowest priority message
+        messages.insert(msg);
+      }
+    } else {
+      messages.insert(msg);
+    }
+  }
+
+  const QueuedMessage& front() const { return *messages.begin(); }
+  void pop() { messages.erase(messages.begin()); }
+  bool empty() const { return messages.empty(); }
+  size_t size() const { return messages.size(); }
+
+ private:
+  struct MessageComparator {
+    bool operator()(const QueuedMessage& a, const QueuedMessage& b) const {
+      return a.priority > b.priority;  // high priority first
+    }
+  };
+  std::multiset<QueuedMessage, MessageComparator> messages;
+};
+
+using Queue = MqttSendQueue<max_mqtt_send_queue, max_mqtt_topic_length, max_mqtt_payload_length>;
+
+// xorshift, the same sequence on every run
+uint32_t random_state;
+uint32_t next() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+constexpr int priorities[] = {0, 0, 0, 0, 5, 10, 20, 40, 100};
+
+}  // namespace
+
+static Queue* queue;
+
+void setUp() {
+  queue = new Queue();
+  random_state = 2463534242U;
+}
+
+void tearDown() { delete queue; }
+
+void test_priority_order_and_fifo() {
+  queue->push("m/", "a", "1", false, 0);
+  queue->push("m/", "b", "2", true, 10);
+  queue->push("m/", "c", "3", false, 0);
+  queue->push("m/", "d", "4", false, 100);
+  queue->push("m/", "e", "5", false, 10);
+  const char* expected[] = {"m/d", "m/b", "m/e", "m/a", "m/c"};
+  for (const char* topic : expected) {
+    TEST_ASSERT_FALSE(queue->empty());
+    TEST_ASSERT_EQUAL_STRING(topic, queue->front().topic);
+    queue->pop();
+  }
+  TEST_ASSERT_TRUE(queue->empty());
+  TEST_ASSERT_EQUAL_UINT(0, queue->size());
+}
+
+void test_full_queue_evicts_lowest_or_drops() {
+  char topic[16];
+  for (unsigned int i = 0; i < Queue::capacity(); i++) {
+    snprintf(topic, sizeof(topic), "%u", i);
+    TEST_ASSERT_TRUE(queue->push("m/", topic, "x", false, 5));
+  }
+  TEST_ASSERT_FALSE(queue->push("m/", "low", "x", false, 5));  // not above the lowest queued priority
+  TEST_ASSERT_EQUAL_UINT32(1, queue->dropped);
+  TEST_ASSERT_TRUE(queue->push("m/", "high", "x", false, 6));
+  TEST_ASSERT_EQUAL_UINT32(1, queue->evicted);
+  TEST_ASSERT_EQUAL_UINT(Queue::capacity(), queue->size());
+  TEST_ASSERT_EQUAL_STRING("m/high", queue->front().topic);
+  // the newest entry of the lowest priority went, the first ones are still there in order
+  queue->pop();
+  TEST_ASSERT_EQUAL_STRING("m/0", queue->front().topic);
+  const char* last = nullptr;
+  while (!queue->empty()) {
+    last = queue->front().topic;
+    queue->pop();
+  }
+  snprintf(topic, sizeof(topic), "m/%u", static_cast<unsigned int>(Queue::capacity() - 2));
+  TEST_ASSERT_EQUAL_STRING(topic, last);
+}
+
+void test_oversized_messages_are_rejected_not_truncated() {
+  char payload[max_mqtt_payload_length + 1];
+  memset(payload, 'p', sizeof(payload) - 1);
+  payload[sizeof(payload) - 1] = '\0';
+  TEST_ASSERT_FALSE(queue->push("m/", "trace", payload, false, 5));
+  TEST_ASSERT_FALSE(queue->push("m/trace", payload, false, 5));
+  TEST_ASSERT_EQUAL_UINT32(2, queue->oversized);
+  TEST_ASSERT_TRUE(queue->empty());
+
+  payload[sizeof(payload) - 2] = '\0';  // exactly the longest payload a slot holds
+  TEST_ASSERT_TRUE(queue->push("m/", "trace", payload, false, 5));
+  TEST_ASSERT_EQUAL_STRING(payload, queue->front().payload);
+
+  char topic[max_mqtt_topic_length];
+  memset(topic, 't', sizeof(topic) - 1);
+  topic[sizeof(topic) - 1] = '\0';
+  TEST_ASSERT_FALSE(queue->push("m/", topic, "x", false, 5));
+  TEST_ASSERT_EQUAL_UINT32(3, queue->oversized);
+  TEST_ASSERT_EQUAL_UINT(1, queue->size());
+}
+
+void test_interned_topics_are_not_copied() {
+  static const char interned[] = "m/battery/soc";
+  TEST_ASSERT_TRUE(queue->push(interned, "55.00", true, 0));
+  TEST_ASSERT_TRUE(queue->front().topic == interned);
+  TEST_ASSERT_TRUE(queue->front().retain);
+}
+
+// random pushes and pops with a fill level around the capacity, both queues must hand out the same sequence
+void test_same_order_as_multiset() {
+  MultisetQueue reference;
+  char topic[16];
+  char payload[16];
+  for (unsigned int i = 0; i < 200000; i++) {
+    const uint32_t r = next();
+    if (r % 8 < 5 || queue->empty()) {
+      const int priority = priorities[r / 8 % (sizeof(priorities) / sizeof(priorities[0]))];
+      snprintf(topic, sizeof(topic), "t%u", i);
+      snprintf(payload, sizeof(payload), "%u", r);
+      queue->push("m/", topic, payload, r & 0x10000, priority);
+      reference.push("m/", topic, payload, r & 0x10000, priority);
+    } else {
+      TEST_ASSERT_FALSE(reference.empty());
+      TEST_ASSERT_EQUAL_STRING(reference.front().topic.c_str(), queue->front().topic);
+      TEST_ASSERT_EQUAL_STRING(reference.front().payload.c_str(), queue->front().payload);
+      TEST_ASSERT_EQUAL(reference.front().retain, queue->front().retain);
+      TEST_ASSERT_EQUAL_INT(reference.front().priority, queue->front().priority);
+      queue->pop();
+      reference.pop();
+    }
+    TEST_ASSERT_EQUAL_UINT(reference.size(), queue->size());
+  }
+  TEST_ASSERT_GREATER_THAN(0, queue->evicted);
+}
+
+// a publish burst beyond the capacity, then drained: telemetry only (one priority) or mixed with logs and infos
+constexpr unsigned int burst = max_mqtt_send_queue + 20;
+static char payloads[burst][16];
+
+template <typename Q>
+static uint64_t timeRun(Q& q, const unsigned int rounds, const bool mixed) {
+  static const char* const topics[] = {"battery/soc", "battery/voltage", "stats/can_tx_sent", "log", "trace"};
+  constexpr size_t priority_count = sizeof(priorities) / sizeof(priorities[0]);
+  const auto start = std::chrono::steady_clock::now();
+  for (unsigned int round = 0; round < rounds; round++) {
+    for (unsigned int i = 0; i < burst; i++) {
+      const int priority = mixed ? priorities[(i + round) % priority_count] : 0;
+      q.push("master/can/", topics[i % 5], payloads[i], false, priority);
+    }
+    while (!q.empty()) {
+      q.pop();
+    }
+  }
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void compareTiming(const bool mixed) {
+  constexpr unsigned int rounds = 2000;
+  for (unsigned int i = 0; i < burst; i++) {
+    snprintf(payloads[i], sizeof(payloads[i]), "%u.%02u", i * 7, i % 100);
+  }
+  MultisetQueue reference;
+  timeRun(*queue, rounds / 10, mixed);  // warm up caches and the allocator
+  timeRun(reference, rounds / 10, mixed);
+  const uint64_t list_ns = timeRun(*queue, rounds, mixed);
+  const uint64_t multiset_ns = timeRun(reference, rounds, mixed);
+  const double operations = static_cast<double>(rounds) * burst;
+  char line[96];
+  snprintf(line, sizeof(line), "ns per push+pop: list %.1f, multiset %.1f", list_ns / operations,
+           multiset_ns / operations);
+  TEST_MESSAGE(line);
+  TEST_ASSERT_LESS_THAN(multiset_ns, list_ns);
+}
+
+// the common case, inserting at the tail is O(1)
+void test_timing_single_priority() { compareTiming(false); }
+
+// mid priorities walk from the tail past the lower ones, still ahead of a tree insert plus two allocations
+void test_timing_mixed_priorities() { compareTiming(true); }
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_priority_order_and_fifo);
+  RUN_TEST(test_full_queue_evicts_lowest_or_drops);
+  RUN_TEST(test_oversized_messages_are_rejected_not_truncated);
+  RUN_TEST(test_interned_topics_are_not_copied);
+  RUN_TEST(test_same_order_as_multiset);
+  RUN_TEST(test_timing_single_priority);
+  RUN_TEST(test_timing_mixed_priorities);
+  return UNITY_END();
+}
@@ -0,0 +1,154 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "battery.h"
+#include "fake_hal.h"
+
+// background update against the FakeUpdater: a good image installs and restarts, a lost connection, a stalled
+// download or a missing image fail without touching the running firmware
+
+static FakeNode* node;
+static Battery* battery;
+
+static void run(const unsigned long ms) {
+  for (unsigned long i = 0; i < ms; i++) {
+    battery->loop();
+    fake_clock.advanceMillis(1);
+  }
+}
+
+static std::vector<std::string> payloads(const char* topic) {
+  std::vector<std::string> found;
+  for (const auto& message : node->mqtt.published) {
+    if (message.topic == topic) {
+      found.push_back(message.payload);
+    }
+  }
+  return found;
+}
+
+static bool logged(const char* text) {
+  for (const std::string& line : payloads("test/log")) {
+    if (line.find(text) != std::string::npos) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void setUp() {
+  fake_clock.now_us = 0;
+  node = new FakeNode();
+  node->mqtt.keep_published = true;
+  node->updater.image_size = 64 * 1024;
+  node->updater.bytes_per_ms = 256;
+  battery = new Battery(node->hal, "test/");
+  battery->begin();
+  battery->connect();
+  run(blink_time);  // past the boot blink, the led is the update's alone
+  node->board.led_changes = 0;
+}
+
+void tearDown() {
+  delete battery;
+  delete node;
+}
+
+// every chunk checked against the image, progress in steps, the led blinking, the bus busy throughout
+void test_update_installs_and_restarts() {
+  node->updater.bytes_per_ms = 16;  // about 4 s, across the 2 s can cycle
+  const uint64_t tx_before = node->can.tx_count;
+  node->mqtt.deliver("test/ota", "/firmware.bin");
+  run(100);
+  TEST_ASSERT_EQUAL(Ota::downloading, battery->ota.state());
+  TEST_ASSERT_EQUAL_UINT32(node->updater.image_size, battery->ota.size());
+  TEST_ASSERT_GREATER_THAN(0, battery->ota.received());
+  // no loop pass after the restart, what is still queued by then never leaves the board
+  for (int ms = 0; ms < 10000 && node->board.restarts == 0; ms++) {
+    run(1);
+  }
+  TEST_ASSERT_EQUAL(Ota::idle, battery->ota.state());
+  TEST_ASSERT_EQUAL_UINT(1, node->updater.installs);
+  TEST_ASSERT_EQUAL_UINT(1, node->board.restarts);
+  TEST_ASSERT_TRUE(logged("ota ok (65536 bytes in"));
+  TEST_ASSERT_TRUE(logged("ota done - restarting!"));
+
+  const std::vector<std::string> progress = payloads("test/ota/progress");
+  TEST_ASSERT_EQUAL_UINT(10, progress.size());
+  TEST_ASSERT_EQUAL_STRING("100", progress.back().c_str());  // out before the restart
+  for (size_t i = 0; i < progress.size(); i++) {
+    TEST_ASSERT_EQUAL_STRING(std::to_string((i + 1) * 10).c_str(), progress[i].c_str());
+  }
+  TEST_ASSERT_GREATER_OR_EQUAL(64, node->board.led_changes);  // at least one per 1 KB chunk
+  TEST_ASSERT_FALSE(node->board.led);
+  TEST_ASSERT_GREATER_THAN(tx_before, node->can.tx_count);
+}
+
+void test_missing_image_fails() {
+  node->updater.image_size = 0;
+  node->mqtt.deliver("test/ota", "/missing.bin");
+  run(10);
+  TEST_ASSERT_EQUAL(Ota::idle, battery->ota.state());
+  TEST_ASSERT_TRUE(logged("ota started [/missing.bin]"));
+  TEST_ASSERT_TRUE(logged("ota http 404 for /missing.bin"));
+  TEST_ASSERT_EQUAL_UINT(0, node->updater.installs);
+  TEST_ASSERT_EQUAL_UINT(0, node->board.restarts);
+}
+
+void test_lost_connection_fails() {
+  node->updater.drop_at = 20000;
+  node->mqtt.deliver("test/ota", "/firmware.bin");
+  run(1000);
+  TEST_ASSERT_EQUAL(Ota::idle, battery->ota.state());
+  const uint32_t received = battery->ota.received();
+  TEST_ASSERT_GREATER_OR_EQUAL(20000, received);
+  TEST_ASSERT_LESS_THAN(20000 + ota_chunk_size, received);
+  char expected[48];
+  snprintf(expected, sizeof(expected), "ota connection lost at %lu bytes", static_cast<unsigned long>(received));
+  TEST_ASSERT_TRUE(logged(expected));
+  TEST_ASSERT_EQUAL_UINT(0, node->updater.installs);
+  TEST_ASSERT_EQUAL_UINT(0, node->board.restarts);
+  TEST_ASSERT_FALSE(node->board.led);
+}
+
+// no data for ota_stall_timeout_ms aborts, not a moment earlier
+void test_stalled_download_fails_after_timeout() {
+  node->mqtt.deliver("test/ota", "/firmware.bin");
+  run(50);
+  node->updater.bytes_per_ms = 0;
+  run(ota_stall_timeout_ms - 100UL);
+  TEST_ASSERT_EQUAL(Ota::downloading, battery->ota.state());
+  const uint32_t received = battery->ota.received();
+  run(200);
+  TEST_ASSERT_EQUAL(Ota::idle, battery->ota.state());
+  char expected[48];
+  snprintf(expected, sizeof(expected), "ota stalled at %lu bytes", static_cast<unsigned long>(received));
+  TEST_ASSERT_TRUE(logged(expected));
+  TEST_ASSERT_EQUAL_UINT(0, node->updater.installs);
+  TEST_ASSERT_EQUAL_UINT(0, node->board.restarts);
+}
+
+void test_second_start_and_long_path_are_refused() {
+  TEST_ASSERT_TRUE(battery->ota.start("/firmware.bin"));
+  TEST_ASSERT_FALSE(battery->ota.start("/other.bin"));
+  run(1000);
+  TEST_ASSERT_EQUAL_UINT(1, node->updater.installs);
+
+  const std::string long_path(max_ota_path_length, 'x');
+  TEST_ASSERT_FALSE(battery->ota.start(long_path.c_str()));
+  TEST_ASSERT_EQUAL(Ota::idle, battery->ota.state());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_update_installs_and_restarts);
+  RUN_TEST(test_missing_image_fails);
+  RUN_TEST(test_lost_connection_fails);
+  RUN_TEST(test_stalled_download_fails_after_timeout);
+  RUN_TEST(test_second_start_and_long_path_are_refused);
+  return UNITY_END();
+}
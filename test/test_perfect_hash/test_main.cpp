@@ -0,0 +1,103 @@
+#include <unity.h>
+
+#include <array>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+#include "perfect_hash.h"
+#include "telemetry.h"
+
+// the compile time perfect hash: every key gets its own slot and finds its own index, nothing else matches
+
+// the mqtt control topics, the firmware checks its own copy with a static_assert
+static constexpr std::array<std::string_view, 8> control_topics = {
+    "ota", "trace", "blink", "restart", "telemetry/mode/set", "metrics/interval/set", "soc_model/enabled/set",
+    "unknown/dump/set",
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+template <size_t N, size_t Slots>
+static void assertCollisionFree(const PerfectHash<N, Slots>& hash, const std::array<std::string_view, N>& keys) {
+  TEST_ASSERT_TRUE(hash.valid());
+  for (size_t i = 0; i < N; i++) {
+    TEST_ASSERT_EQUAL_INT(static_cast<int>(i), hash.find(keys[i]));
+  }
+}
+
+void test_control_topics() {
+  static constexpr PerfectHash<control_topics.size(), 16> hash(control_topics);
+  static_assert(hash.valid(), "resolved at compile time");
+  assertCollisionFree(hash, control_topics);
+  TEST_ASSERT_EQUAL_INT(-1, hash.find(""));
+  TEST_ASSERT_EQUAL_INT(-1, hash.find("ot"));
+  TEST_ASSERT_EQUAL_INT(-1, hash.find("otaa"));
+  TEST_ASSERT_EQUAL_INT(-1, hash.find("OTA"));
+  TEST_ASSERT_EQUAL_INT(-1, hash.find("telemetry/mode"));
+  TEST_ASSERT_EQUAL_INT(-1, hash.find("limits/max_voltage/set"));
+}
+
+// short keys differing in a single character, half the slots taken
+void test_short_keys() {
+  static constexpr std::array<std::string_view, 4> keys = {"rx", "tx", "on", "off"};
+  static constexpr PerfectHash<keys.size(), 8> hash(keys);
+  static_assert(hash.valid(), "four keys fit eight slots");
+  assertCollisionFree(hash, keys);
+  TEST_ASSERT_EQUAL_INT(-1, hash.find("candump"));
+}
+
+void test_single_key() {
+  static constexpr std::array<std::string_view, 1> keys = {"only"};
+  static constexpr PerfectHash<keys.size(), 1> hash(keys);
+  assertCollisionFree(hash, keys);
+  TEST_ASSERT_EQUAL_INT(-1, hash.find("other"));  // same slot, the compare rejects it
+}
+
+// two equal keys can never be told apart, no seed may be reported as found
+void test_duplicate_keys_are_invalid() {
+  const std::array<std::string_view, 3> keys = {"a", "b", "a"};
+  const PerfectHash<keys.size(), 4> hash(keys);
+  TEST_ASSERT_FALSE(hash.valid());
+}
+
+// generated key sets in the shape of the topics, at the load factors the firmware uses
+void test_generated_key_sets() {
+  static std::string storage[24];
+  std::array<std::string_view, 24> keys{};
+  for (unsigned int round = 0; round < 50; round++) {
+    for (size_t i = 0; i < keys.size(); i++) {
+      char text[40];
+      snprintf(text, sizeof(text), "group%u/value_%u", static_cast<unsigned int>(i % 3),
+               static_cast<unsigned int>(round * 31 + i * 7));
+      storage[i] = text;
+      keys[i] = storage[i];
+    }
+    const PerfectHash<keys.size(), 64> hash(keys);
+    assertCollisionFree(hash, keys);
+    TEST_ASSERT_EQUAL_INT(-1, hash.find("group0/value_"));
+  }
+}
+
+void test_telemetry_topics() {
+  for (uint8_t i = 0; i < Telemetry::count; i++) {
+    const auto id = static_cast<Telemetry::Id>(i);
+    TEST_ASSERT_EQUAL_INT(id, Telemetry::find(Telemetry::topic(id)));
+  }
+  TEST_ASSERT_EQUAL_INT(Telemetry::count, Telemetry::find("battery/soc/set"));
+  TEST_ASSERT_EQUAL_INT(Telemetry::count, Telemetry::find("battery"));
+  TEST_ASSERT_EQUAL_INT(Telemetry::count, Telemetry::find(""));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_control_topics);
+  RUN_TEST(test_short_keys);
+  RUN_TEST(test_single_key);
+  RUN_TEST(test_duplicate_keys_are_invalid);
+  RUN_TEST(test_generated_key_sets);
+  RUN_TEST(test_telemetry_topics);
+  return UNITY_END();
+}
@@ -0,0 +1,65 @@
+#include <unity.h>
+
+#include "publish_policy.h"
+
+// the deadband and the rate limit of one topic: changes inside min_interval are held back and flushed when it ends,
+// unchanged values only go out with the refresh
+
+static constexpr PublishPolicy policy{0.5, 1000UL, 60UL * 1000UL};
+
+static PublishFilter* filter;
+
+void setUp() {
+  filter = new PublishFilter();
+  TEST_ASSERT_TRUE(filter->shouldPublish(10.0, 0, policy));  // the first value always goes out
+}
+
+void tearDown() { delete filter; }
+
+void test_deadband() {
+  TEST_ASSERT_FALSE(filter->shouldPublish(10.4, 2000, policy));
+  TEST_ASSERT_FALSE(filter->flushDue(5000, policy));
+  TEST_ASSERT_TRUE(filter->shouldPublish(10.5, 6000, policy));
+}
+
+// a change right after a publish waits for the interval, then goes out once
+void test_change_inside_interval_is_held_back() {
+  TEST_ASSERT_FALSE(filter->shouldPublish(12.0, 200, policy));
+  TEST_ASSERT_FALSE(filter->flushDue(999, policy));
+  TEST_ASSERT_TRUE(filter->flushDue(1000, policy));
+  TEST_ASSERT_FALSE(filter->flushDue(5000, policy));
+  // compared against the flushed value from now on
+  TEST_ASSERT_FALSE(filter->shouldPublish(12.2, 3000, policy));
+  TEST_ASSERT_TRUE(filter->shouldPublish(11.0, 3000, policy));
+}
+
+// a value back within the deadband of the last publish before the interval ends has nothing to flush
+void test_change_taken_back_is_not_flushed() {
+  TEST_ASSERT_FALSE(filter->shouldPublish(12.0, 200, policy));
+  TEST_ASSERT_FALSE(filter->shouldPublish(10.1, 600, policy));
+  TEST_ASSERT_FALSE(filter->flushDue(2000, policy));
+}
+
+// a change published directly after the interval leaves nothing held back
+void test_later_offer_replaces_the_flush() {
+  TEST_ASSERT_FALSE(filter->shouldPublish(12.0, 200, policy));
+  TEST_ASSERT_TRUE(filter->shouldPublish(13.0, 1000, policy));
+  TEST_ASSERT_FALSE(filter->flushDue(2500, policy));
+}
+
+void test_refresh_and_invalidate() {
+  TEST_ASSERT_FALSE(filter->shouldPublish(10.0, 59999, policy));
+  TEST_ASSERT_TRUE(filter->shouldPublish(10.0, 60000, policy));
+  filter->invalidate();
+  TEST_ASSERT_TRUE(filter->shouldPublish(10.0, 60001, policy));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_deadband);
+  RUN_TEST(test_change_inside_interval_is_held_back);
+  RUN_TEST(test_change_taken_back_is_not_flushed);
+  RUN_TEST(test_later_offer_replaces_the_flush);
+  RUN_TEST(test_refresh_and_invalidate);
+  return UNITY_END();
+}
@@ -0,0 +1,149 @@
+#include <unity.h>
+
+#include <cstdint>
+#include <cstdio>
+
+#include "battery.h"
+#include "fake_hal.h"
+
+// */set streams reach flash coalesced: after a quiet period, after the maximum delay, early for significant changes,
+// and right before a restart
+
+static FakeNode* node;
+static Battery* battery;
+
+// loop passes every 10 ms with the master heartbeat every 30 s, a long run must not end in a heartbeat restart
+static void run(const unsigned long ms) {
+  for (unsigned long elapsed = 0; elapsed < ms; elapsed += 10) {
+    if (fake_clock.millis() % 30000UL == 0) {
+      node->mqtt.deliver(mqtt_master_heartbeat_topic, "1");
+    }
+    battery->loop();
+    fake_clock.advanceMillis(10);
+  }
+}
+
+static void set(const char* topic, const float value) {
+  char payload[16];
+  snprintf(payload, sizeof(payload), "%.2f", static_cast<double>(value));
+  node->mqtt.deliver(topic, payload);
+}
+
+void setUp() {
+  fake_clock.now_us = 0;
+  node = new FakeNode();
+  battery = new Battery(node->hal, "test/");
+  battery->begin();
+  battery->connect();
+  run(1000);
+}
+
+void tearDown() {
+  delete battery;
+  delete node;
+}
+
+void test_nothing_written_without_changes() {
+  run(20UL * 60UL * 1000UL);
+  TEST_ASSERT_EQUAL_UINT32(0, node->storage.saves);
+  TEST_ASSERT_EQUAL_UINT32(0, battery->store.stats.flushes);
+}
+
+// ten small sets a second apart are one write, once the values were quiet for settings_flush_quiet_ms
+void test_burst_is_one_write_after_quiet_period() {
+  const float start = battery->can.limit_battery_voltage_max;
+  for (int i = 1; i <= 10; i++) {
+    set("test/limits/max_voltage/set", start + static_cast<float>(i) * 0.1f);
+    run(1000);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, node->storage.saves);
+  run(settings_flush_quiet_ms - 1000UL - 20UL);
+  TEST_ASSERT_EQUAL_UINT32(0, node->storage.saves);
+  run(40);
+  TEST_ASSERT_EQUAL_UINT32(1, node->storage.saves);
+  TEST_ASSERT_EQUAL_UINT32(9, battery->store.stats.coalesced);
+  run(5UL * 60UL * 1000UL);
+  TEST_ASSERT_EQUAL_UINT32(1, node->storage.saves);
+}
+
+// a value that never settles (soc every 10 s) is still written once per settings_flush_max_delay_ms
+void test_max_delay_bounds_a_moving_value() {
+  const unsigned long first_set = fake_clock.millis();
+  float soc = 50.f;
+  while (fake_clock.millis() - first_set < 2 * settings_flush_max_delay_ms + 5000UL) {
+    soc += 0.01f;
+    set("test/battery/soc/set", soc);
+    run(10000);
+  }
+  TEST_ASSERT_EQUAL_UINT32(2, node->storage.saves);
+  TEST_ASSERT_EQUAL_UINT32(0, battery->store.stats.failed);
+}
+
+// a tenth of the stored value or more goes out once settings_flush_min_interval_ms passed since the last write,
+// without waiting for a quiet period
+void test_significant_change_is_written_early() {
+  set("test/limits/max_charge_current/set", battery->can.limit_charge_current_max + 0.1f);
+  run(settings_flush_quiet_ms + 100UL);
+  TEST_ASSERT_EQUAL_UINT32(1, node->storage.saves);
+  const unsigned long due = fake_clock.millis() + settings_flush_min_interval_ms;  // the write was up to 100 ms ago
+
+  // significant 10 s after that write, then small sets every 5 s so it never gets quiet
+  run(10000);
+  set("test/limits/max_charge_current/set", battery->can.limit_charge_current_max * 2);
+  float voltage = battery->can.limit_battery_voltage_max;
+  while (fake_clock.millis() + 5000UL < due - 200UL) {
+    voltage += 0.1f;
+    set("test/limits/max_voltage/set", voltage);
+    run(5000);
+  }
+  run(due - 200UL - fake_clock.millis());
+  TEST_ASSERT_EQUAL_UINT32(1, node->storage.saves);
+  run(400);
+  TEST_ASSERT_EQUAL_UINT32(2, node->storage.saves);
+}
+
+// a restart writes what is pending, and the next boot starts from it
+void test_restart_flushes_and_boot_restores() {
+  set("test/limits/max_voltage/set", 233.3f);
+  set("test/battery/soh/set", 87.5f);
+  run(100);
+  TEST_ASSERT_EQUAL_UINT32(0, node->storage.saves);
+  node->mqtt.deliver("test/restart", "");
+  run(10);
+  TEST_ASSERT_EQUAL_UINT(1, node->board.restarts);
+  TEST_ASSERT_EQUAL_UINT32(1, node->storage.saves);
+
+  FakeNode rebooted;
+  rebooted.storage.blobs = node->storage.blobs;
+  Battery restored(rebooted.hal, "test/");
+  restored.begin();
+  TEST_ASSERT_EQUAL_FLOAT(233.3f, restored.can.limit_battery_voltage_max);
+  TEST_ASSERT_EQUAL_FLOAT(87.5f, restored.can.soh_percent);
+  TEST_ASSERT_EQUAL_FLOAT(battery->can.limit_battery_voltage_min, restored.can.limit_battery_voltage_min);
+}
+
+// a failed write keeps the change pending and is retried after another quiet period
+void test_failed_write_is_retried() {
+  node->storage.fail = true;
+  set("test/limits/max_voltage/set", battery->can.limit_battery_voltage_max + 0.5f);
+  run(settings_flush_quiet_ms + 100UL);
+  TEST_ASSERT_EQUAL_UINT32(1, battery->store.stats.failed);
+  TEST_ASSERT_EQUAL_UINT32(0, battery->store.stats.flushes);
+  node->storage.fail = false;
+  run(settings_flush_quiet_ms - 1000UL);
+  TEST_ASSERT_EQUAL_UINT32(0, battery->store.stats.flushes);
+  run(1200);
+  TEST_ASSERT_EQUAL_UINT32(1, battery->store.stats.flushes);
+  TEST_ASSERT_EQUAL_UINT32(1, node->storage.saves);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_nothing_written_without_changes);
+  RUN_TEST(test_burst_is_one_write_after_quiet_period);
+  RUN_TEST(test_max_delay_bounds_a_moving_value);
+  RUN_TEST(test_significant_change_is_written_early);
+  RUN_TEST(test_restart_flushes_and_boot_restores);
+  RUN_TEST(test_failed_write_is_retried);
+  return UNITY_END();
+}
@@ -0,0 +1,99 @@
+#include <unity.h>
+
+#include <cstdint>
+
+#include "battery.h"
+#include "fake_hal.h"
+
+// the coulomb counter on the can side and the soc corrections the master sends from the mqtt side
+
+static FakeNode* node;
+static Battery* battery;
+
+// 0x91 with 215 V and the given current in A, positive charges the battery
+static CanFrame currentFrame(const float current_a) {
+  const auto raw = static_cast<uint16_t>(static_cast<int16_t>(current_a * 10 / soc_model_current_sign));
+  CanFrame frame{};
+  frame.id = 0x91;
+  frame.len = 8;
+  frame.data[0] = 2150 >> 8;
+  frame.data[1] = 2150 & 0xFF;
+  frame.data[2] = raw >> 8;
+  frame.data[3] = raw & 0xFF;
+  return frame;
+}
+
+// one 0x91 frame per second, like the inverter sends them
+static void run(const unsigned long seconds, const float current_a) {
+  for (unsigned long s = 0; s < seconds; s++) {
+    node->can.inject(currentFrame(current_a));
+    for (int ms = 0; ms < 1000; ms++) {
+      battery->loop();
+      fake_clock.advanceMillis(1);
+    }
+  }
+}
+
+void setUp() {
+  fake_clock.now_us = 0;
+  node = new FakeNode();
+  battery = new Battery(node->hal, "test/");
+  battery->begin();
+  battery->connect();
+  battery->can.full_capacity_ah = 100;
+  battery->can.limit_charge_current_max = 50;
+  battery->can.limit_discharge_current_max = 50;
+  node->mqtt.deliver("test/soc_model/enabled/set", "on");
+  node->mqtt.deliver("test/battery/soc/set", "50");
+  run(1, 0);
+}
+
+void tearDown() {
+  delete battery;
+  delete node;
+}
+
+void test_counts_charge() {
+  run(360, 10);  // 1 Ah into 100 Ah
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 51.0f, battery->can.soc_percent);
+}
+
+// the current is clamped to the configured limits before it is integrated
+void test_current_is_clamped() {
+  run(360, -200);  // 50 A at most, 5 Ah
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, 45.0f, battery->can.soc_percent);
+}
+
+// a set between two frames is taken over and counted on from, not overwritten by the model
+void test_master_set_wins() {
+  run(60, 10);
+  node->mqtt.deliver("test/battery/soc/set", "80");
+  run(1, 10);
+  TEST_ASSERT_FLOAT_WITHIN(0.01f, 80.0f, battery->can.soc_percent);
+  run(360, 10);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 81.0f, battery->can.soc_percent);
+}
+
+// switched off, frames leave the soc alone and sets still apply
+void test_disabled_model_keeps_soc() {
+  node->mqtt.deliver("test/soc_model/enabled/set", "off");
+  run(360, 10);
+  TEST_ASSERT_EQUAL_FLOAT(50.0f, battery->can.soc_percent);
+  node->mqtt.deliver("test/battery/soc/set", "62.5");
+  run(1, 10);
+  TEST_ASSERT_EQUAL_FLOAT(62.5f, battery->can.soc_percent);
+
+  // back on, counting starts from the soc as it is then
+  node->mqtt.deliver("test/soc_model/enabled/set", "on");
+  run(361, 10);
+  TEST_ASSERT_FLOAT_WITHIN(0.05f, 63.5f, battery->can.soc_percent);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_counts_charge);
+  RUN_TEST(test_current_is_clamped);
+  RUN_TEST(test_master_set_wins);
+  RUN_TEST(test_disabled_model_keeps_soc);
+  return UNITY_END();
+}
@@ -0,0 +1,241 @@
+#include <unity.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "battery.h"
+#include "fake_hal.h"
+
+// the unknown frame table: per id statistics, a full table that keeps its ids and only counts the rest, the digest
+// json and the dump, and a flood of unknown frames that never pushes telemetry out of the mqtt queue
+
+static FakeNode* node;
+static Battery* battery;
+
+// just enough of a json parser to tell valid from invalid: objects, arrays, strings without escapes, numbers
+struct Json {
+  const char* p;
+
+  bool value() {
+    if (*p == '{') {
+      return container('}', true);
+    }
+    if (*p == '[') {
+      return container(']', false);
+    }
+    if (*p == '"') {
+      return string();
+    }
+    return number();
+  }
+  bool container(const char close, const bool object) {
+    p++;
+    if (*p == close) {
+      p++;
+      return true;
+    }
+    for (;;) {
+      if (object && !(string() && *p++ == ':')) {
+        return false;
+      }
+      if (!value()) {
+        return false;
+      }
+      if (*p == close) {
+        p++;
+        return true;
+      }
+      if (*p++ != ',') {
+        return false;
+      }
+    }
+  }
+  bool string() {
+    if (*p++ != '"') {
+      return false;
+    }
+    while (*p && *p != '"') {
+      p++;
+    }
+    return *p++ == '"';
+  }
+  bool number() {
+    const char* start = p;
+    p += *p == '-';
+    while (isdigit(static_cast<unsigned char>(*p)) || *p == '.') {
+      p++;
+    }
+    return p > start && isdigit(static_cast<unsigned char>(p[-1]));
+  }
+};
+
+static bool validJson(const std::string& text) {
+  Json json{text.c_str()};
+  return json.value() && *json.p == '\0';
+}
+
+static CanFrame frame(const uint32_t id, const bool extd = false, const uint8_t data0 = 0) {
+  CanFrame frame{};
+  frame.id = id;
+  frame.extd = extd;
+  frame.len = 2;
+  frame.data[0] = data0;
+  frame.data[1] = 0xAB;
+  return frame;
+}
+
+static void run(const unsigned long ms) {
+  for (unsigned long i = 0; i < ms; i++) {
+    battery->loop();
+    fake_clock.advanceMillis(1);
+  }
+}
+
+static std::vector<std::string> payloads(const char* topic) {
+  std::vector<std::string> found;
+  for (const auto& message : node->mqtt.published) {
+    if (message.topic == topic) {
+      found.push_back(message.payload);
+    }
+  }
+  return found;
+}
+
+void setUp() {
+  fake_clock.now_us = 0;
+  node = new FakeNode();
+  node->mqtt.keep_published = true;
+  battery = new Battery(node->hal, "test/");
+  battery->begin();
+  battery->connect();
+}
+
+void tearDown() {
+  delete battery;
+  delete node;
+}
+
+// count, first and last seen, the latest payload and the period of one id, dumped on request
+void test_statistics_and_dump() {
+  for (uint8_t i = 0; i < 20; i++) {
+    battery->can.readMessage(frame(0x321, false, i));
+    run(100);
+  }
+  TEST_ASSERT_EQUAL_UINT32(1, battery->unknown.ids());
+  node->mqtt.published.clear();
+  node->mqtt.deliver("test/unknown/dump/set", "1");
+  run(10);
+  const std::vector<std::string> lines = payloads("test/unknown/frames");
+  TEST_ASSERT_EQUAL_UINT(1, lines.size());
+  TEST_ASSERT_EQUAL_STRING("321#13AB count 20 first 0 ms last 1900 ms period 100.0 ms", lines[0].c_str());
+}
+
+// standard and extended frames of the same number are two ids
+void test_standard_and_extended_are_apart() {
+  battery->can.readMessage(frame(0x123));
+  battery->can.readMessage(frame(0x123, true));
+  battery->can.readMessage(frame(0x123, true));
+  TEST_ASSERT_EQUAL_UINT32(2, battery->unknown.ids());
+  node->mqtt.published.clear();
+  battery->unknown.dump();
+  run(10);
+  const std::vector<std::string> lines = payloads("test/unknown/frames");
+  TEST_ASSERT_EQUAL_UINT(2, lines.size());
+  const bool standard_first = lines[0].compare(0, 4, "123#") == 0;
+  const std::string& standard = standard_first ? lines[0] : lines[1];
+  const std::string& extended = standard_first ? lines[1] : lines[0];
+  TEST_ASSERT_EQUAL_STRING_LEN("123#00AB count 1 ", standard.c_str(), 17);
+  TEST_ASSERT_EQUAL_STRING_LEN("00000123#00AB count 2 ", extended.c_str(), 22);
+}
+
+// at three quarters of the slots the table stops taking ids: tracked ids are never evicted and keep counting,
+// frames of further ids only count as overflow
+void test_full_table_keeps_its_ids() {
+  constexpr uint32_t limit = can_unknown_slots / 4 * 3;
+  for (uint32_t id = 0; id < limit + 10; id++) {
+    battery->can.readMessage(frame(0x400 + id * 7));
+  }
+  TEST_ASSERT_EQUAL_UINT32(limit, battery->unknown.ids());
+  TEST_ASSERT_EQUAL_UINT32(10, battery->unknown.overflow);
+
+  for (uint32_t id = 0; id < limit + 10; id++) {
+    battery->can.readMessage(frame(0x400 + id * 7));
+  }
+  TEST_ASSERT_EQUAL_UINT32(limit, battery->unknown.ids());
+  TEST_ASSERT_EQUAL_UINT32(20, battery->unknown.overflow);
+
+  // the dump goes out a few lines per loop and has every tracked id with both of its frames
+  node->mqtt.published.clear();
+  battery->unknown.dump();
+  run(limit / can_capture_dump_per_poll + 2);
+  const std::vector<std::string> lines = payloads("test/unknown/frames");
+  TEST_ASSERT_EQUAL_UINT(limit, lines.size());
+  for (uint32_t id = 0; id < limit; id++) {
+    char prefix[24];
+    snprintf(prefix, sizeof(prefix), "%03lX#00AB count 2 ", static_cast<unsigned long>(0x400 + id * 7));
+    bool found = false;
+    for (const std::string& line : lines) {
+      found |= line.compare(0, strlen(prefix), prefix) == 0;
+    }
+    TEST_ASSERT_TRUE_MESSAGE(found, prefix);
+  }
+}
+
+// the busiest ids of the interval, busiest first, in a complete json object
+void test_digest() {
+  for (unsigned long second = 0; second < can_unknown_digest_interval_ms / 1000; second++) {
+    for (uint32_t id = 0; id < 8; id++) {
+      for (uint32_t n = 0; n <= id; n++) {
+        battery->can.readMessage(frame(0x18DA0000 + id, true));
+      }
+    }
+    battery->can.readMessage(frame(0x7E8));
+    run(1000);
+  }
+  run(10);
+  const std::vector<std::string> digests = payloads("test/unknown");
+  TEST_ASSERT_EQUAL_UINT(1, digests.size());
+  const std::string& json = digests[0];
+  TEST_ASSERT_TRUE_MESSAGE(validJson(json), json.c_str());
+  const char* header = "{\"ids\":9,\"new_ids\":9,\"frames\":2220,\"total\":2220,\"overflow\":0,\"busiest\":{";
+  TEST_ASSERT_EQUAL_STRING_LEN(header, json.c_str(), strlen(header));
+  const size_t first = json.find("\"18da0007\":[480,");
+  const size_t second = json.find("\"18da0006\":[420,");
+  TEST_ASSERT_TRUE(first != std::string::npos && second != std::string::npos && first < second);
+  TEST_ASSERT_TRUE(json.find("\"7e8\"") == std::string::npos);  // not among the busiest
+  TEST_ASSERT_EQUAL_UINT(can_unknown_digest_top, std::count(json.begin(), json.end(), '['));
+}
+
+// an unknown flood of a busy shared bus: the table absorbs it, no mqtt message per frame, telemetry keeps its place
+void test_flood_does_not_evict_telemetry() {
+  for (unsigned long ms = 0; ms < 2 * can_unknown_digest_interval_ms; ms++) {
+    for (uint32_t i = 0; i < 4; i++) {
+      battery->can.readMessage(frame(0x500 + (ms * 4 + i) % 100));
+    }
+    if (ms % 30000 == 0) {
+      node->mqtt.deliver(mqtt_master_heartbeat_topic, "1");
+    }
+    run(1);
+  }
+  run(10);
+  TEST_ASSERT_EQUAL_UINT32(0, battery->mqtt.queueEvicted());
+  TEST_ASSERT_EQUAL_UINT32(0, battery->mqtt.queueDropped());
+  TEST_ASSERT_EQUAL_UINT(2, payloads("test/unknown").size());
+  TEST_ASSERT_FALSE(payloads("test/battery/soc").empty());
+  TEST_ASSERT_LESS_THAN(2000, node->mqtt.publish_count);  // against 480000 unknown frames
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_statistics_and_dump);
+  RUN_TEST(test_standard_and_extended_are_apart);
+  RUN_TEST(test_full_table_keeps_its_ids);
+  RUN_TEST(test_digest);
+  RUN_TEST(test_flood_does_not_evict_telemetry);
+  return UNITY_END();
+}